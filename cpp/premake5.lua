@@ -69,14 +69,32 @@ workspace "zstd-codec"
         location "./build-gmake"
 
 
-externalproject "zstd"
-    location (zstd_root_dir())
-    kind "StaticLib"
-    language "C"
-    targetdir (zstd_lib_dir())
-
-    filter "options:with-emscripten"
+-- NOTE: multi-threaded compression (ZSTD_c_nbWorkers) requires libzstd built with ZSTD_MULTITHREAD.
+--       zstd's `lib-mt` target builds it so, Emscripten builds keep the single-threaded libzstd.
+if _OPTIONS["with-emscripten"] then
+    externalproject "zstd"
+        location (zstd_root_dir())
+        kind "StaticLib"
+        language "C"
+        targetdir (zstd_lib_dir())
         targetextension ".bc"
+else
+    project "zstd"
+        kind "Makefile"
+
+        buildcommands {
+            string.format("$(MAKE) -C %s lib-mt", path.getabsolute(zstd_lib_dir())),
+        }
+
+        rebuildcommands {
+            string.format("$(MAKE) -C %s clean", path.getabsolute(zstd_lib_dir())),
+            string.format("$(MAKE) -C %s lib-mt", path.getabsolute(zstd_lib_dir())),
+        }
+
+        cleancommands {
+            string.format("$(MAKE) -C %s clean", path.getabsolute(zstd_lib_dir())),
+        }
+end
 
 
 project "zstd-codec"
@@ -131,11 +149,22 @@ project "test-zstd-codec"
         "test/**.cc",
     }
 
+    dependson "zstd"
+
     links {
-        "zstd",
         "zstd-codec",
     }
 
+    filter "options:with-emscripten"
+        links { "zstd" }
+
+    -- NOTE: "zstd" is a Makefile project on native platforms, link its static library directly
+    filter "options:not with-emscripten"
+        links { string.format("%s/libzstd.a", path.getabsolute(zstd_lib_dir())) }
+
+    filter "system:linux"
+        links { "pthread" }
+
 
 project "zstd-codec-binding"
     kind "SharedLib"
@@ -1,3 +1,5 @@
+#include <climits>
+
 #include <emscripten/bind.h>
 
 #include "../../zstd-codec.h"
@@ -128,13 +130,13 @@ void CloneToVector(Vec<u8>& dest, val src)
 }
 
 
-val CloneAsTypedArray(const Vec<u8>& src)
+static val clone_as_typed_array(const u8* src, size_t src_size)
 {
     val heapu8 = val::module_property("HEAPU8");
     val src_buffer = heap_buffer();
-    val src_view = heapu8["constructor"].new_(src_buffer, reinterpret_cast<uintptr_t>(&src[0]), src.size());
+    val src_view = heapu8["constructor"].new_(src_buffer, reinterpret_cast<uintptr_t>(src), src_size);
 
-    val dest_buffer = src_buffer["constructor"].new_(src.size());
+    val dest_buffer = src_buffer["constructor"].new_(src_size);
     val dest_view = heapu8["constructor"].new_(dest_buffer);
 
     dest_view.call<void>("set", src_view);
@@ -142,6 +144,12 @@ val CloneAsTypedArray(const Vec<u8>& src)
 }
 
 
+val CloneAsTypedArray(const Vec<u8>& src)
+{
+    return clone_as_typed_array(src.data(), src.size());
+}
+
+
 val ToTypedArrayView(const Vec<u8>& src)
 {
     val memory = heap_buffer();
@@ -166,6 +174,60 @@ ZstdDecompressionDict* CreateDecompressionDict(val dict_bytes)
 }
 
 
+// ---- codec bindings (implementations) --------------------------------------
+
+// NOTE: js side expects an int, negative values are errors.
+static int to_js_result(const ZstdResult& result)
+{
+    if (!result.ok()) return static_cast<int>(result.error);
+    if (result.size > static_cast<u64>(INT_MAX)) return static_cast<int>(ZstdError::SizeTooLarge);
+
+    return static_cast<int>(result.size);
+}
+
+
+int CodecCompressBound(const ZstdCodec& codec, int src_size)
+{
+    return to_js_result(codec.CompressBound(src_size));
+}
+
+
+int CodecContentSize(const ZstdCodec& codec, const Vec<u8>& src)
+{
+    return to_js_result(codec.ContentSize(src));
+}
+
+
+int CodecDecompressedSize(const ZstdCodec& codec, const Vec<u8>& src)
+{
+    return to_js_result(codec.DecompressedSize(src));
+}
+
+
+int CodecCompress(const ZstdCodec& codec, Vec<u8>& dest, const Vec<u8>& src, int compression_level)
+{
+    return to_js_result(codec.Compress(dest, src, compression_level));
+}
+
+
+int CodecDecompress(const ZstdCodec& codec, Vec<u8>& dest, const Vec<u8>& src)
+{
+    return to_js_result(codec.Decompress(dest, src));
+}
+
+
+int CodecCompressUsingDict(const ZstdCodec& codec, Vec<u8>& dest, const Vec<u8>& src, const ZstdCompressionDict& cdict)
+{
+    return to_js_result(codec.CompressUsingDict(dest, src, cdict));
+}
+
+
+int CodecDecompressUsingDict(const ZstdCodec& codec, Vec<u8>& dest, const Vec<u8>& src, const ZstdDecompressionDict& ddict)
+{
+    return to_js_result(codec.DecompressUsingDict(dest, src, ddict));
+}
+
+
 // ---- stream bindings (implementations) -------------------------------------
 
 //
@@ -202,8 +264,8 @@ bool ZstdCompressStreamBinding::Transform(val chunk, val callback)
     Vec<u8> chunk_vec;
     CloneToVector(chunk_vec, chunk);
 
-    return stream_.Transform(chunk_vec, [&callback](const Vec<u8>& compressed_vec) {
-        val compressed = CloneAsTypedArray(compressed_vec);
+    return stream_.Transform(chunk_vec, [&callback](const ByteBuffer& compressed_bytes) {
+        val compressed = clone_as_typed_array(compressed_bytes.data(), compressed_bytes.size());
         callback(compressed);
     });
 }
@@ -211,8 +273,8 @@ bool ZstdCompressStreamBinding::Transform(val chunk, val callback)
 
 bool ZstdCompressStreamBinding::Flush(val callback)
 {
-    return stream_.Flush([&callback](const Vec<u8>& compressed_vec) {
-        val compressed = CloneAsTypedArray(compressed_vec);
+    return stream_.Flush([&callback](const ByteBuffer& compressed_bytes) {
+        val compressed = clone_as_typed_array(compressed_bytes.data(), compressed_bytes.size());
         callback(compressed);
     });
 }
@@ -220,8 +282,8 @@ bool ZstdCompressStreamBinding::Flush(val callback)
 
 bool ZstdCompressStreamBinding::End(val callback)
 {
-    return stream_.End([&callback](const Vec<u8>& compressed_vec) {
-        val compressed = CloneAsTypedArray(compressed_vec);
+    return stream_.End([&callback](const ByteBuffer& compressed_bytes) {
+        val compressed = clone_as_typed_array(compressed_bytes.data(), compressed_bytes.size());
         callback(compressed);
     });
 }
@@ -261,8 +323,8 @@ bool ZstdDecompressStreamBinding::Transform(val chunk, val callback)
     Vec<u8> chunk_vec;
     CloneToVector(chunk_vec, chunk);
 
-    return stream_.Transform(chunk_vec, [&callback](const Vec<u8>& decompressed_vec) {
-        val decompressed = CloneAsTypedArray(decompressed_vec);
+    return stream_.Transform(chunk_vec, [&callback](const ByteBuffer& decompressed_bytes) {
+        val decompressed = clone_as_typed_array(decompressed_bytes.data(), decompressed_bytes.size());
         callback(decompressed);
     });
 }
@@ -270,8 +332,8 @@ bool ZstdDecompressStreamBinding::Transform(val chunk, val callback)
 
 bool ZstdDecompressStreamBinding::Flush(val callback)
 {
-    return stream_.Flush([&callback](const Vec<u8>& decompressed_vec) {
-        val decompressed = CloneAsTypedArray(decompressed_vec);
+    return stream_.Flush([&callback](const ByteBuffer& decompressed_bytes) {
+        val decompressed = clone_as_typed_array(decompressed_bytes.data(), decompressed_bytes.size());
         callback(decompressed);
     });
 }
@@ -279,8 +341,8 @@ bool ZstdDecompressStreamBinding::Flush(val callback)
 
 bool ZstdDecompressStreamBinding::End(val callback)
 {
-    return stream_.End([&callback](const Vec<u8>& decompressed_vec) {
-        val decompressed = CloneAsTypedArray(decompressed_vec);
+    return stream_.End([&callback](const ByteBuffer& decompressed_bytes) {
+        val decompressed = clone_as_typed_array(decompressed_bytes.data(), decompressed_bytes.size());
         callback(decompressed);
     });
 }
@@ -304,12 +366,13 @@ EMSCRIPTEN_BINDINGS(zstd) {
 
     class_<ZstdCodec>("ZstdCodec")
         .constructor<>()
-        .function("compressBound", &ZstdCodec::CompressBound)
-        .function("contentSize", &ZstdCodec::ContentSize)
-        .function("compress", &ZstdCodec::Compress)
-        .function("decompress", &ZstdCodec::Decompress)
-        .function("compressUsingDict", &ZstdCodec::CompressUsingDict)
-        .function("decompressUsingDict", &ZstdCodec::DecompressUsingDict)
+        .function("compressBound", &CodecCompressBound)
+        .function("contentSize", &CodecContentSize)
+        .function("decompressedSize", &CodecDecompressedSize)
+        .function("compress", &CodecCompress)
+        .function("decompress", &CodecDecompress)
+        .function("compressUsingDict", &CodecCompressUsingDict)
+        .function("decompressUsingDict", &CodecDecompressUsingDict)
         ;
 
     class_<ZstdCompressStreamBinding>("ZstdCompressStreamBinding")
@@ -1,10 +1,146 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <vector>
 
 using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
 using usize = std::size_t;
 
 template <typename T>
 using Vec = std::vector<T>;
+
+
+// Growable byte buffer, unlike Vec<u8> growing never zero-fills new bytes.
+//
+// NOTE: bytes in [size(), capacity()) and bytes added by resize() are
+//       uninitialized, callers must write them before reading.
+class ByteBuffer
+{
+public:
+    ByteBuffer()
+        : bytes_()
+        , size_(0)
+        , capacity_(0)
+    {
+    }
+
+    explicit ByteBuffer(usize size)
+        : ByteBuffer()
+    {
+        resize(size);
+    }
+
+    ByteBuffer(const u8* src, usize size)
+        : ByteBuffer()
+    {
+        append(src, size);
+    }
+
+    ByteBuffer(ByteBuffer&& other) noexcept
+        : bytes_(std::move(other.bytes_))
+        , size_(other.size_)
+        , capacity_(other.capacity_)
+    {
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    ByteBuffer& operator=(ByteBuffer&& other) noexcept
+    {
+        bytes_ = std::move(other.bytes_);
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        other.size_ = 0;
+        other.capacity_ = 0;
+        return *this;
+    }
+
+    ByteBuffer(const ByteBuffer&) = delete;
+    ByteBuffer& operator=(const ByteBuffer&) = delete;
+
+    u8* data() { return bytes_.get(); }
+    const u8* data() const { return bytes_.get(); }
+
+    u8* begin() { return data(); }
+    u8* end() { return data() + size_; }
+    const u8* begin() const { return data(); }
+    const u8* end() const { return data() + size_; }
+
+    u8& operator[](usize index) { return bytes_[index]; }
+    const u8& operator[](usize index) const { return bytes_[index]; }
+
+    usize size() const { return size_; }
+    usize capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    // NOTE: keeps capacity, so the buffer can be refilled without allocation
+    void clear() { size_ = 0; }
+
+    void reserve(usize capacity)
+    {
+        if (capacity <= capacity_) return;
+        Reallocate(capacity);
+    }
+
+    void resize(usize size)
+    {
+        if (size > capacity_) Reallocate(std::max(size, capacity_ * 2));
+        size_ = size;
+    }
+
+    void shrink_to_fit()
+    {
+        if (size_ == capacity_) return;
+
+        if (size_ == 0) {
+            bytes_.reset();
+            capacity_ = 0;
+        }
+        else {
+            Reallocate(size_);
+        }
+    }
+
+    void append(const u8* src, usize size)
+    {
+        if (size == 0) return;
+
+        const auto offset = size_;
+        resize(size_ + size);
+        std::memcpy(data() + offset, src, size);
+    }
+
+    // NOTE: hands the underlying storage (of capacity() bytes) to the caller,
+    //       and leaves this buffer empty.
+    std::unique_ptr<u8[]> release()
+    {
+        size_ = 0;
+        capacity_ = 0;
+        return std::move(bytes_);
+    }
+
+    Vec<u8> ToVec() const
+    {
+        return Vec<u8>(begin(), end());
+    }
+
+private:
+    void Reallocate(usize capacity)
+    {
+        // NOTE: `new u8[n]` default-initializes, bytes are not zero-filled
+        std::unique_ptr<u8[]> bytes(new u8[capacity]);
+        if (size_ > 0) std::memcpy(bytes.get(), bytes_.get(), size_);
+
+        bytes_ = std::move(bytes);
+        capacity_ = capacity;
+    }
+
+    std::unique_ptr<u8[]>   bytes_;
+    usize                   size_;
+    usize                   capacity_;
+};
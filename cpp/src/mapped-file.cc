@@ -0,0 +1,58 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped-file.h"
+
+
+static usize FileSize(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    return static_cast<usize>(st.st_size);
+}
+
+
+static u8* MapFile(const char* path, usize size)
+{
+    // NOTE: empty files can not be mapped
+    if (size == 0) return nullptr;
+
+    const auto fd = open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // NOTE: the mapping stays valid after the descriptor is closed
+    return addr == MAP_FAILED ? nullptr : static_cast<u8*>(addr);
+}
+
+
+//
+// MappedFile
+//
+////////////////////////////////////////////////////////////////////////////////
+
+MappedFile::MappedFile(const std::string& path)
+    : MappedFile(path.c_str())
+{
+}
+
+
+MappedFile::MappedFile(const char* path)
+    : MappedFile(path, FileSize(path))
+{
+}
+
+
+MappedFile::MappedFile(const char* path, usize size)
+    : Resource(MapFile(path, size), [size](u8* addr) { munmap(addr, size); })
+    , size_(get() != nullptr ? size : 0)
+{
+}
+
+
+bool MappedFile::fail() const
+{
+    return get() == nullptr;
+}
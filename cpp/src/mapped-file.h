@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+#include "common-types.h"
+#include "raii-resource.h"
+
+
+// Read-only memory mapping of a whole file.
+//
+// NOTE: share it with std::shared_ptr to tie the lifetime of dictionaries loaded
+//       by reference to the mapping.
+class MappedFile : public Resource<u8>
+{
+public:
+    explicit MappedFile(const std::string& path);
+    explicit MappedFile(const char* path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool fail() const;
+
+    const u8* data() const { return get(); }
+    usize size() const { return size_; }
+
+private:
+    MappedFile(const char* path, usize size);
+
+    const usize size_;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+// NOTE: for library sources only, uses zstd's static-only api (ZSTD_customMem)
+#ifndef ZSTD_STATIC_LINKING_ONLY
+#define ZSTD_STATIC_LINKING_ONLY
+#endif
+
+#include "zstd.h"
+#include "zstd-allocator.h"
+
+
+// NOTE: zstd's default allocator for nullptr
+inline ZSTD_customMem ToCustomMem(IZstdAllocator* allocator)
+{
+    if (allocator == nullptr) return ZSTD_defaultCMem;
+    return ZSTD_customMem { IZstdAllocator::AllocateCallback, IZstdAllocator::FreeCallback, allocator };
+}
+
+
+// NOTE: objects in a workspace are released with the workspace itself
+template <typename T>
+inline void CloseStatic(T*)
+{
+}
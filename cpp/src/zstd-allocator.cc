@@ -0,0 +1,233 @@
+#include <cstdlib>
+
+#include "zstd-allocator.h"
+
+
+// NOTE: keeps blocks aligned as malloc does
+static const usize kAlignment = 16;
+
+
+static usize AlignUp(usize size)
+{
+    return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+
+//
+// IZstdAllocator
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void* IZstdAllocator::AllocateCallback(void* opaque, usize size)
+{
+    return static_cast<IZstdAllocator*>(opaque)->Allocate(size);
+}
+
+
+void IZstdAllocator::FreeCallback(void* opaque, void* address)
+{
+    static_cast<IZstdAllocator*>(opaque)->Free(address);
+}
+
+
+//
+// ZstdPoolAllocator
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// NOTE: every block starts with a header holding its size class
+struct PoolBlockHeader
+{
+    usize   size_class;
+    usize   padding;
+};
+
+static_assert(sizeof(PoolBlockHeader) == kAlignment, "header must keep payload aligned");
+
+static const usize kUncachedClass = ~static_cast<usize>(0);
+
+
+static usize SizeClassOf(usize size)
+{
+    usize shift = ZstdPoolAllocator::kMinClassShift;
+    while ((static_cast<usize>(1) << shift) < size) {
+        if (++shift > ZstdPoolAllocator::kMaxClassShift) return kUncachedClass;
+    }
+
+    return shift - ZstdPoolAllocator::kMinClassShift;
+}
+
+
+static usize ClassSize(usize size_class)
+{
+    return static_cast<usize>(1) << (size_class + ZstdPoolAllocator::kMinClassShift);
+}
+
+
+const usize ZstdPoolAllocator::kMinClassShift;
+const usize ZstdPoolAllocator::kMaxClassShift;
+const usize ZstdPoolAllocator::kClassCount;
+
+
+ZstdPoolAllocator::ZstdPoolAllocator(usize max_cached_bytes)
+    : max_cached_bytes_(max_cached_bytes)
+    , mutex_()
+    , free_lists_()
+    , cached_bytes_(0)
+    , allocations_(0)
+    , frees_(0)
+    , system_allocations_(0)
+{
+}
+
+
+ZstdPoolAllocator::~ZstdPoolAllocator()
+{
+    for (auto& free_list : free_lists_) {
+        for (auto block : free_list) {
+            std::free(block);
+        }
+    }
+}
+
+
+void* ZstdPoolAllocator::Allocate(usize size)
+{
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+
+    const auto size_class = SizeClassOf(size);
+    if (size_class != kUncachedClass) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& free_list = free_lists_[size_class];
+        if (!free_list.empty()) {
+            auto block = free_list.back();
+            free_list.pop_back();
+            cached_bytes_ -= ClassSize(size_class);
+            return static_cast<u8*>(block) + sizeof(PoolBlockHeader);
+        }
+    }
+
+    const auto block_size = size_class != kUncachedClass ? ClassSize(size_class) : size;
+    auto block = static_cast<PoolBlockHeader*>(std::malloc(sizeof(PoolBlockHeader) + block_size));
+    if (block == nullptr) return nullptr;
+
+    system_allocations_.fetch_add(1, std::memory_order_relaxed);
+    block->size_class = size_class;
+    return block + 1;
+}
+
+
+void ZstdPoolAllocator::Free(void* address)
+{
+    if (address == nullptr) return;
+    frees_.fetch_add(1, std::memory_order_relaxed);
+
+    auto block = static_cast<PoolBlockHeader*>(address) - 1;
+    const auto size_class = block->size_class;
+    if (size_class != kUncachedClass) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cached_bytes_ + ClassSize(size_class) <= max_cached_bytes_) {
+            free_lists_[size_class].push_back(block);
+            cached_bytes_ += ClassSize(size_class);
+            return;
+        }
+    }
+
+    std::free(block);
+}
+
+
+usize ZstdPoolAllocator::CachedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cached_bytes_;
+}
+
+
+ZstdAllocatorStats ZstdPoolAllocator::Stats() const
+{
+    return ZstdAllocatorStats {
+        allocations_.load(std::memory_order_relaxed),
+        frees_.load(std::memory_order_relaxed),
+        system_allocations_.load(std::memory_order_relaxed),
+    };
+}
+
+
+//
+// ZstdArenaAllocator
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdArenaAllocator::ZstdArenaAllocator(usize capacity)
+    : bytes_(new u8[AlignUp(capacity) + kAlignment])
+    , capacity_(AlignUp(capacity))
+    , used_(0)
+    , high_water_(0)
+    , allocations_(0)
+    , frees_(0)
+{
+}
+
+
+ZstdArenaAllocator::~ZstdArenaAllocator()
+{
+}
+
+
+void* ZstdArenaAllocator::Allocate(usize size)
+{
+    // NOTE: `new u8[]` is not guaranteed to be 16-byte aligned, skip to the boundary
+    const auto base = reinterpret_cast<uintptr_t>(bytes_.get());
+    const auto offset = AlignUp(base) - base;
+
+    const auto block_size = AlignUp(size);
+    if (block_size > capacity_ - used_) return nullptr;
+
+    auto block = bytes_.get() + offset + used_;
+    used_ += block_size;
+    high_water_ = std::max(high_water_, used_);
+    allocations_ += 1;
+    return block;
+}
+
+
+void ZstdArenaAllocator::Free(void* address)
+{
+    if (address != nullptr) frees_ += 1;
+}
+
+
+void ZstdArenaAllocator::Reset()
+{
+    used_ = 0;
+}
+
+
+usize ZstdArenaAllocator::Capacity() const
+{
+    return capacity_;
+}
+
+
+usize ZstdArenaAllocator::Used() const
+{
+    return used_;
+}
+
+
+usize ZstdArenaAllocator::HighWater() const
+{
+    return high_water_;
+}
+
+
+ZstdAllocatorStats ZstdArenaAllocator::Stats() const
+{
+    // NOTE: the arena itself is the only system allocation
+    return ZstdAllocatorStats {
+        allocations_,
+        frees_,
+        1,
+    };
+}
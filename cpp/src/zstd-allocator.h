@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "common-types.h"
+
+
+// Memory source of zstd objects (contexts, dictionaries and streams), passed to
+// zstd as ZSTD_customMem { AllocateCallback, FreeCallback, allocator }.
+//
+// NOTE: must outlive every object created with it. zstd handles allocation failures,
+//       Allocate may return nullptr.
+class IZstdAllocator
+{
+public:
+    virtual ~IZstdAllocator() {}
+    virtual void* Allocate(usize size) = 0;
+    virtual void Free(void* address) = 0;
+
+    // NOTE: signatures of ZSTD_allocFunction and ZSTD_freeFunction, `opaque` is the allocator
+    static void* AllocateCallback(void* opaque, usize size);
+    static void FreeCallback(void* opaque, void* address);
+};
+
+
+struct ZstdAllocatorStats
+{
+    usize   allocations;
+    usize   frees;
+    usize   system_allocations;     // allocations passed to the system allocator (malloc)
+};
+
+
+// Recycles freed blocks by power-of-two size classes, so recreating contexts of the same
+// parameters reuses their workspaces without calling the system allocator.
+//
+// NOTE: thread-safe. blocks over the largest class are not cached, and at most
+//       `max_cached_bytes` are kept in free-lists.
+class ZstdPoolAllocator : public IZstdAllocator
+{
+public:
+    static const usize kMinClassShift = 6;      // 64 bytes
+    static const usize kMaxClassShift = 30;     // 1 GiB
+
+    explicit ZstdPoolAllocator(usize max_cached_bytes);
+    virtual ~ZstdPoolAllocator();
+
+    ZstdPoolAllocator(const ZstdPoolAllocator&) = delete;
+    ZstdPoolAllocator& operator=(const ZstdPoolAllocator&) = delete;
+
+    virtual void* Allocate(usize size);
+    virtual void Free(void* address);
+
+    usize CachedBytes() const;
+    ZstdAllocatorStats Stats() const;
+
+private:
+    static const usize kClassCount = kMaxClassShift - kMinClassShift + 1;
+
+    const usize             max_cached_bytes_;
+
+    mutable std::mutex      mutex_;
+    Vec<void*>              free_lists_[kClassCount];
+    usize                   cached_bytes_;
+
+    std::atomic<usize>      allocations_;
+    std::atomic<usize>      frees_;
+    std::atomic<usize>      system_allocations_;
+};
+
+
+// Bump allocator over a single block, for objects of a request scope.
+// Free is a no-op, Reset reclaims the whole arena at once.
+//
+// NOTE: not thread-safe. allocations fail when the arena is exhausted.
+class ZstdArenaAllocator : public IZstdAllocator
+{
+public:
+    explicit ZstdArenaAllocator(usize capacity);
+    virtual ~ZstdArenaAllocator();
+
+    ZstdArenaAllocator(const ZstdArenaAllocator&) = delete;
+    ZstdArenaAllocator& operator=(const ZstdArenaAllocator&) = delete;
+
+    virtual void* Allocate(usize size);
+    virtual void Free(void* address);
+
+    // NOTE: objects allocated from the arena must have been destroyed
+    void Reset();
+
+    usize Capacity() const;
+    usize Used() const;
+    usize HighWater() const;
+    ZstdAllocatorStats Stats() const;
+
+private:
+    std::unique_ptr<u8[]>   bytes_;
+    usize                   capacity_;
+    usize                   used_;
+    usize                   high_water_;
+    usize                   allocations_;
+    usize                   frees_;
+};
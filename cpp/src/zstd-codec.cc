@@ -1,31 +1,22 @@
+#include <cstdint>
 #include <cstdio>
 #include <functional>
 
 #include "zstd.h"
+#include "zstd_errors.h"
 #include "zstd-codec.h"
+#include "zstd-context.h"
 #include "zstd-dict.h"
-#include "raii-resource.h"
 
 #if DEBUG
 # define USE_DEBUG_ERROR_HANDLER (1)
 #endif
 
 
-static const int ERR_UNKNOWN = -1;
-static const int ERR_SIZE_TOO_LARGE = -2;
-
-static const int ERR_ALLOCATE_CCTX = -3;
-static const int ERR_ALLOCATE_DCTX = -4;
-
-static const int ERR_LOAD_CDICT = -5;
-static const int ERR_LOAD_DDICT = -6;
-
-
 class IErrorHandler
 {
 public:
     virtual void OnZstdError(size_t rc) = 0;
-    virtual void OnSizeError(size_t rc) = 0;
 };
 
 
@@ -37,11 +28,6 @@ public:
     {
         printf("## zstd error: %s\n", ZSTD_getErrorName(rc));
     }
-
-    virtual void OnSizeError(size_t rc)
-    {
-        printf("## size error: %s\n", ZSTD_getErrorName(rc));
-    }
 };
 
 
@@ -50,49 +36,23 @@ static DebugErrorHandler s_debug_handler;
 #endif // USE_DEBUG_ERROR_HANDLER
 
 
-class CompressContext : public Resource<ZSTD_CCtx>
-{
-public:
-    CompressContext()
-        : Resource(ZSTD_createCCtx(), CloseContext)
-    {
-    }
-
-    bool fail() const
-    {
-        return get() == nullptr;
-    }
-
-private:
-    static void CloseContext(ZSTD_CCtx* cctx)
-    {
-        ZSTD_freeCCtx(cctx);
-    }
-};
-
-
-class DecompressContext : public Resource<ZSTD_DCtx>
+// NOTE: grow `dest` to `dest_size` (`dest_size` is a result, may be error),
+//       and shrink it to the written size after `fill`.
+template <typename Fill>
+static ZstdResult FillBuffer(ByteBuffer& dest, const ZstdResult& dest_size, Fill fill)
 {
-public:
-    DecompressContext()
-        : Resource(ZSTD_createDCtx(), CloseContext)
-    {
-    }
+    if (!dest_size.ok()) return dest_size;
+    if (dest_size.size > static_cast<u64>(SIZE_MAX)) return ZstdResult::Error(ZstdError::SizeTooLarge);
 
-    bool fail() const
-    {
-        return get() == nullptr;
-    }
+    dest.resize(static_cast<usize>(dest_size.size));
+    const auto result = fill(dest.data(), dest.size());
+    dest.resize(result.ok() ? static_cast<usize>(result.size) : 0u);
 
-private:
-    static void CloseContext(ZSTD_DCtx* dctx)
-    {
-        ZSTD_freeDCtx(dctx);
-    }
-};
+    return result;
+}
 
 
-static int ToResult(size_t rc, IErrorHandler* error_handler = nullptr)
+static ZstdResult ToResult(size_t rc, IErrorHandler* error_handler = nullptr)
 {
 #if USE_DEBUG_ERROR_HANDLER
     if (error_handler == nullptr) {
@@ -102,69 +62,445 @@ static int ToResult(size_t rc, IErrorHandler* error_handler = nullptr)
 
     if (ZSTD_isError(rc)) {
         if (error_handler != nullptr) error_handler->OnZstdError(rc);
-        return ERR_UNKNOWN;
+        return ZstdResult::Error(ZstdError::Zstd, ZSTD_getErrorCode(rc));
     }
-    else if (rc >= static_cast<size_t>(INT_MAX)) {
-        if (error_handler != nullptr) error_handler->OnSizeError(rc);
-        return ERR_SIZE_TOO_LARGE;
+
+    return ZstdResult::Ok(rc);
+}
+
+
+static ZstdResult ToContentSizeResult(unsigned long long content_size)
+{
+    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN) return ZstdResult::Error(ZstdError::ContentSizeUnknown);
+    if (content_size == ZSTD_CONTENTSIZE_ERROR) return ZstdResult::Error(ZstdError::Zstd, ZSTD_error_prefix_unknown);
+
+    return ZstdResult::Ok(content_size);
+}
+
+
+//
+// ZstdResult
+//
+////////////////////////////////////////////////////////////////////////////////
+
+const char* ZstdResult::ErrorName() const
+{
+    switch (error) {
+    case ZstdError::None:               return "no error";
+    case ZstdError::Zstd:               return ZSTD_getErrorString(static_cast<ZSTD_ErrorCode>(zstd_code));
+    case ZstdError::SizeTooLarge:       return "size too large";
+    case ZstdError::AllocateCCtx:       return "cannot allocate compression context";
+    case ZstdError::AllocateDCtx:       return "cannot allocate decompression context";
+    case ZstdError::LoadCDict:          return "cannot load compression dictionary";
+    case ZstdError::LoadDDict:          return "cannot load decompression dictionary";
+    case ZstdError::ContentSizeUnknown: return "content size unknown";
+    case ZstdError::SrcSizeTooSmall:    return "src size too small";
+    case ZstdError::InvalidParams:      return "invalid compression parameters";
     }
 
-    return static_cast<int>(rc);
+    return "unknown error";
+}
+
+
+//
+// ZstdCodec
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdCodec::ZstdCodec()
+    : pool_(nullptr)
+    , dict_observer_(nullptr)
+    , allocator_(nullptr)
+    , external_cctx_(nullptr)
+    , external_dctx_(nullptr)
+    , cctx_()
+    , dctx_()
+{
+}
+
+
+ZstdCodec::ZstdCodec(ZstdContextPool& pool)
+    : pool_(&pool)
+    , dict_observer_(nullptr)
+    , allocator_(nullptr)
+    , external_cctx_(nullptr)
+    , external_dctx_(nullptr)
+    , cctx_()
+    , dctx_()
+{
+}
+
+
+ZstdCodec::ZstdCodec(CompressContext& cctx, DecompressContext& dctx)
+    : pool_(nullptr)
+    , dict_observer_(nullptr)
+    , allocator_(nullptr)
+    , external_cctx_(&cctx)
+    , external_dctx_(&dctx)
+    , cctx_()
+    , dctx_()
+{
+}
+
+
+ZstdCodec::ZstdCodec(IZstdAllocator& allocator)
+    : ZstdCodec()
+{
+    allocator_ = &allocator;
+}
+
+
+ZstdCodec::~ZstdCodec()
+{
 }
 
 
-int ZstdCodec::CompressBound(usize src_size) const
+ZstdResult ZstdCodec::CompressBound(usize src_size) const
 {
     const auto rc = ZSTD_compressBound(src_size);
     return ToResult(rc);
 }
 
 
-int ZstdCodec::ContentSize(const Vec<u8>& src) const
+ZstdResult ZstdCodec::ContentSize(const Vec<u8>& src) const
+{
+    return ContentSize(src.data(), src.size());
+}
+
+
+ZstdResult ZstdCodec::ContentSize(const u8* src, usize src_size) const
+{
+    const auto content_size = ZSTD_getFrameContentSize(src, src_size);
+    return ToContentSizeResult(content_size);
+}
+
+
+ZstdResult ZstdCodec::DecompressedSize(const Vec<u8>& src) const
+{
+    return DecompressedSize(src.data(), src.size());
+}
+
+
+ZstdResult ZstdCodec::DecompressedSize(const u8* src, usize src_size) const
+{
+    const auto decompressed_size = ZSTD_findDecompressedSize(src, src_size);
+    return ToContentSizeResult(decompressed_size);
+}
+
+
+ZstdResult ZstdCodec::FrameInfo(ZstdFrameInfo& info, const Vec<u8>& src) const
+{
+    return FrameInfo(info, src.data(), src.size());
+}
+
+
+ZstdResult ZstdCodec::FrameInfo(ZstdFrameInfo& info, const u8* src, usize src_size) const
+{
+    ZSTD_frameHeader header;
+    const auto rc = ZSTD_getFrameHeader(&header, src, src_size);
+    if (ZSTD_isError(rc)) return ToResult(rc);
+    if (rc > 0) return ZstdResult::SrcSizeTooSmall(rc);
+
+    // NOTE: fails for windows over zstd's default limit (e.g. `zstd --long=31` frames),
+    //       the header is still reported, so callers can decide to raise the limit.
+    const auto decoder_memory = ZSTD_estimateDStreamSize_fromFrame(src, src_size);
+
+    const auto has_content_size = header.frameContentSize != ZSTD_CONTENTSIZE_UNKNOWN;
+
+    info.skippable = header.frameType == ZSTD_skippableFrame;
+    info.has_content_size = has_content_size;
+    info.has_checksum = header.checksumFlag != 0;
+    info.content_size = has_content_size ? header.frameContentSize : 0;
+    info.window_size = header.windowSize;
+    info.dict_id = info.skippable ? 0 : header.dictID;     // NOTE: magic variant for skippable frames
+    info.header_size = header.headerSize;
+    info.decoder_memory = ZSTD_isError(decoder_memory) ? 0 : decoder_memory;
+
+    return ZstdResult::Ok(header.headerSize);
+}
+
+
+ZstdResult ZstdCodec::Compress(Vec<u8>& dest, const Vec<u8>& src, int compression_level) const
+{
+    return Compress(dest.data(), dest.size(), src.data(), src.size(), compression_level);
+}
+
+
+ZstdResult ZstdCodec::Compress(u8* dest, usize dest_size, const u8* src, usize src_size, int compression_level) const
+{
+    auto context = AcquireCompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateCCtx);
+
+    const auto rc = ZSTD_compressCCtx(context->get(),
+                                      dest, dest_size,
+                                      src, src_size, compression_level);
+    return ToResult(rc);
+}
+
+
+ZstdResult ZstdCodec::Decompress(Vec<u8>& dest, const Vec<u8>& src) const
+{
+    return Decompress(dest.data(), dest.size(), src.data(), src.size());
+}
+
+
+ZstdResult ZstdCodec::Decompress(u8* dest, usize dest_size, const u8* src, usize src_size) const
+{
+    auto context = AcquireDecompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateDCtx);
+
+    const auto rc = ZSTD_decompressDCtx(context->get(),
+                                        dest, dest_size,
+                                        src, src_size);
+    return ToResult(rc);
+}
+
+
+ZstdResult ZstdCodec::Compress(ByteBuffer& dest, const u8* src, usize src_size, int compression_level) const
+{
+    return FillBuffer(dest, CompressBound(src_size), [&](u8* dest_bytes, usize dest_size) {
+        return Compress(dest_bytes, dest_size, src, src_size, compression_level);
+    });
+}
+
+
+ZstdResult ZstdCodec::Decompress(ByteBuffer& dest, const u8* src, usize src_size) const
+{
+    return FillBuffer(dest, DecompressedSize(src, src_size), [&](u8* dest_bytes, usize dest_size) {
+        return Decompress(dest_bytes, dest_size, src, src_size);
+    });
+}
+
+
+ZstdResult ZstdCodec::Compress(Vec<u8>& dest, const Vec<u8>& src, const ZstdCompressionParams& params) const
+{
+    return Compress(dest.data(), dest.size(), src.data(), src.size(), params);
+}
+
+
+ZstdResult ZstdCodec::Compress(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdCompressionParams& params) const
 {
-    const auto rc = ZSTD_getFrameContentSize(&src[0], src.size());
+    if (params.fail()) return ZstdResult::Error(ZstdError::InvalidParams);
+
+    auto context = AcquireCompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateCCtx);
+
+    const auto params_rc = params.ApplyTo(context->get());
+    if (ZSTD_isError(params_rc)) return ToResult(params_rc);
+
+    const auto rc = ZSTD_compress2(context->get(),
+                                   dest, dest_size,
+                                   src, src_size);
     return ToResult(rc);
 }
 
 
-int ZstdCodec::Compress(Vec<u8>& dest, const Vec<u8>& src, int compression_level) const
+ZstdResult ZstdCodec::Compress(ByteBuffer& dest, const u8* src, usize src_size, const ZstdCompressionParams& params) const
 {
-    const auto rc = ZSTD_compress(&dest[0], dest.size(),
-                                  &src[0], src.size(), compression_level);
+    return FillBuffer(dest, CompressBound(src_size), [&](u8* dest_bytes, usize dest_size) {
+        return Compress(dest_bytes, dest_size, src, src_size, params);
+    });
+}
+
+
+ZstdResult ZstdCodec::CompressUsingPrefix(u8* dest, usize dest_size, const u8* src, usize src_size, const u8* prefix, usize prefix_size, int compression_level) const
+{
+    ZstdCompressionParams params(compression_level);
+    if (params.fail() || !params.SetPatchFrom(prefix_size, src_size)) return ZstdResult::Error(ZstdError::InvalidParams);
+
+    auto context = AcquireCompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateCCtx);
+
+    auto rc = params.ApplyTo(context->get());
+    if (!ZSTD_isError(rc)) rc = ZSTD_CCtx_refPrefix(context->get(), prefix, prefix_size);
+    if (ZSTD_isError(rc)) return ToResult(rc);
+
+    rc = ZSTD_compress2(context->get(),
+                        dest, dest_size,
+                        src, src_size);
     return ToResult(rc);
 }
 
 
-int ZstdCodec::Decompress(Vec<u8>& dest, const Vec<u8>& src) const
+ZstdResult ZstdCodec::CompressUsingPrefix(ByteBuffer& dest, const u8* src, usize src_size, const u8* prefix, usize prefix_size, int compression_level) const
+{
+    return FillBuffer(dest, CompressBound(src_size), [&](u8* dest_bytes, usize dest_size) {
+        return CompressUsingPrefix(dest_bytes, dest_size, src, src_size, prefix, prefix_size, compression_level);
+    });
+}
+
+
+ZstdResult ZstdCodec::DecompressUsingPrefix(u8* dest, usize dest_size, const u8* src, usize src_size, const u8* prefix, usize prefix_size) const
 {
-    const auto rc = ZSTD_decompress(&dest[0], dest.size(),
-                                    &src[0], src.size());
+    auto context = AcquireDecompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateDCtx);
+
+    auto rc = ZSTD_DCtx_refPrefix(context->get(), prefix, prefix_size);
+    if (ZSTD_isError(rc)) return ToResult(rc);
+
+    rc = ZSTD_decompressDCtx(context->get(),
+                             dest, dest_size,
+                             src, src_size);
     return ToResult(rc);
 }
 
 
-int ZstdCodec::CompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdCompressionDict& cdict) const
+ZstdResult ZstdCodec::DecompressUsingPrefix(ByteBuffer& dest, const u8* src, usize src_size, const u8* prefix, usize prefix_size) const
+{
+    return FillBuffer(dest, ContentSize(src, src_size), [&](u8* dest_bytes, usize dest_size) {
+        return DecompressUsingPrefix(dest_bytes, dest_size, src, src_size, prefix, prefix_size);
+    });
+}
+
+
+ZstdResult ZstdCodec::CompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdCompressionDict& cdict) const
+{
+    return CompressUsingDict(dest.data(), dest.size(), src.data(), src.size(), cdict);
+}
+
+
+ZstdResult ZstdCodec::CompressUsingDict(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdCompressionDict& cdict) const
 {
-    CompressContext context;
-    if (context.fail()) return ERR_ALLOCATE_CCTX;
+    auto context = AcquireCompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateCCtx);
 
-    const auto rc = ZSTD_compress_usingCDict(context.get(),
-                                             &dest[0], dest.size(),
-                                             &src[0], src.size(),
+    const auto rc = ZSTD_compress_usingCDict(context->get(),
+                                             dest, dest_size,
+                                             src, src_size,
                                              cdict.get());
+    if (!ZSTD_isError(rc) && dict_observer_ != nullptr) {
+        dict_observer_->OnCompressUsingDict(cdict, src, src_size, rc);
+    }
+
     return ToResult(rc);
 }
 
 
-int ZstdCodec::DecompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdDecompressionDict& ddict) const
+ZstdResult ZstdCodec::DecompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdDecompressionDict& ddict) const
+{
+    return DecompressUsingDict(dest.data(), dest.size(), src.data(), src.size(), ddict);
+}
+
+
+ZstdResult ZstdCodec::DecompressUsingDict(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdDecompressionDict& ddict) const
 {
-    DecompressContext context;
-    if (context.fail()) return ERR_ALLOCATE_DCTX;
+    auto context = AcquireDecompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateDCtx);
 
-    const auto rc = ZSTD_decompress_usingDDict(context.get(),
-                                               &dest[0], dest.size(),
-                                               &src[0], src.size(),
+    const auto rc = ZSTD_decompress_usingDDict(context->get(),
+                                               dest, dest_size,
+                                               src, src_size,
                                                ddict.get());
     return ToResult(rc);
 }
 
+
+ZstdResult ZstdCodec::CompressUsingDict(ByteBuffer& dest, const u8* src, usize src_size, const ZstdCompressionDict& cdict) const
+{
+    return FillBuffer(dest, CompressBound(src_size), [&](u8* dest_bytes, usize dest_size) {
+        return CompressUsingDict(dest_bytes, dest_size, src, src_size, cdict);
+    });
+}
+
+
+ZstdResult ZstdCodec::DecompressUsingDict(ByteBuffer& dest, const u8* src, usize src_size, const ZstdDecompressionDict& ddict) const
+{
+    return FillBuffer(dest, DecompressedSize(src, src_size), [&](u8* dest_bytes, usize dest_size) {
+        return DecompressUsingDict(dest_bytes, dest_size, src, src_size, ddict);
+    });
+}
+
+
+ZstdResult ZstdCodec::DecompressUsingDicts(Vec<u8>& dest, const Vec<u8>& src, const ZstdDecompressionDictSet& ddicts) const
+{
+    return DecompressUsingDicts(dest.data(), dest.size(), src.data(), src.size(), ddicts);
+}
+
+
+ZstdResult ZstdCodec::DecompressUsingDicts(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdDecompressionDictSet& ddicts) const
+{
+    auto context = AcquireDecompressContext();
+    if (context == nullptr) return ZstdResult::Error(ZstdError::AllocateDCtx);
+
+    // NOTE: frames may use different dictionaries, decode them one by one
+    usize src_offset = 0;
+    usize dest_offset = 0;
+    while (src_offset < src_size) {
+        const auto frame_src = src + src_offset;
+        const auto frame_size = ZSTD_findFrameCompressedSize(frame_src, src_size - src_offset);
+        if (ZSTD_isError(frame_size)) return ToResult(frame_size);
+
+        const auto dict_id = ZSTD_getDictID_fromFrame(frame_src, frame_size);
+        const auto ddict = dict_id != 0 ? ddicts.Find(dict_id) : nullptr;
+        if (dict_id != 0 && ddict == nullptr) return ZstdResult::Error(ZstdError::Zstd, ZSTD_error_dictionary_wrong);
+
+        const auto rc = ZSTD_decompress_usingDDict(context->get(),
+                                                   dest + dest_offset, dest_size - dest_offset,
+                                                   frame_src, frame_size,
+                                                   ddict != nullptr ? ddict->get() : nullptr);
+        if (ZSTD_isError(rc)) return ToResult(rc);
+
+        src_offset += frame_size;
+        dest_offset += rc;
+    }
+
+    return ZstdResult::Ok(dest_offset);
+}
+
+
+ZstdResult ZstdCodec::DecompressUsingDicts(ByteBuffer& dest, const u8* src, usize src_size, const ZstdDecompressionDictSet& ddicts) const
+{
+    return FillBuffer(dest, DecompressedSize(src, src_size), [&](u8* dest_bytes, usize dest_size) {
+        return DecompressUsingDicts(dest_bytes, dest_size, src, src_size, ddicts);
+    });
+}
+
+
+void ZstdCodec::SetDictObserver(IDictCompressionObserver* observer)
+{
+    dict_observer_ = observer;
+}
+
+
+CompressContextLease ZstdCodec::AcquireCompressContext() const
+{
+    if (pool_ != nullptr) return pool_->BorrowCompressContext();
+
+    if (external_cctx_ != nullptr) {
+        if (!external_cctx_->Reset()) return CompressContextLease();
+        return CompressContextLease(external_cctx_, ContextReleaser<CompressContext>());
+    }
+
+    if (cctx_ == nullptr) {
+        std::unique_ptr<CompressContext> context(allocator_ != nullptr ? new CompressContext(*allocator_) : new CompressContext());
+        if (context->fail()) return CompressContextLease();
+
+        cctx_ = std::move(context);
+    }
+
+    // NOTE: reuse workspace of previous calls, but start from clean parameters
+    if (!cctx_->Reset()) return CompressContextLease();
+    return CompressContextLease(cctx_.get(), ContextReleaser<CompressContext>());
+}
+
+
+DecompressContextLease ZstdCodec::AcquireDecompressContext() const
+{
+    if (pool_ != nullptr) return pool_->BorrowDecompressContext();
+
+    if (external_dctx_ != nullptr) {
+        if (!external_dctx_->Reset()) return DecompressContextLease();
+        return DecompressContextLease(external_dctx_, ContextReleaser<DecompressContext>());
+    }
+
+    if (dctx_ == nullptr) {
+        std::unique_ptr<DecompressContext> context(allocator_ != nullptr ? new DecompressContext(*allocator_) : new DecompressContext());
+        if (context->fail()) return DecompressContextLease();
+
+        dctx_ = std::move(context);
+    }
+
+    // NOTE: reuse workspace of previous calls, but start from clean parameters
+    if (!dctx_->Reset()) return DecompressContextLease();
+    return DecompressContextLease(dctx_.get(), ContextReleaser<DecompressContext>());
+}
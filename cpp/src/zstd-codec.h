@@ -1,22 +1,126 @@
 #pragma once
 
+#include <memory>
 
 #include "common-types.h"
+#include "zstd-context-pool.h"
 #include "zstd-dict.h"
+#include "zstd-params.h"
+#include "zstd-result.h"
 
 
+// Frame header parameters, available from the first bytes of a frame.
+struct ZstdFrameInfo
+{
+    bool    skippable;
+    bool    has_content_size;
+    bool    has_checksum;
+    u64     content_size;       // 0 if unknown, payload size for skippable frames
+    u64     window_size;
+    u32     dict_id;            // 0 if no dictionary id
+    usize   header_size;
+    usize   decoder_memory;     // estimated memory to decode the frame with a stream, 0 if unknown
+};
+
+
+// Receives payloads compressed by ZstdCodec::CompressUsingDict, see ZstdDictRetrainer.
+//
+// NOTE: called on the compressing thread after each successful compression,
+//       implementations must be thread-safe when the codec is shared.
+class IDictCompressionObserver
+{
+public:
+    virtual ~IDictCompressionObserver() {}
+    virtual void OnCompressUsingDict(const ZstdCompressionDict& cdict, const u8* src, usize src_size, usize compressed_size) = 0;
+};
+
+
+// NOTE: by default ZstdCodec owns zstd contexts which are created on first use
+//       and reused by later calls, so an instance must not be shared across threads.
+//       an instance created with ZstdContextPool borrows contexts from the pool
+//       on every call instead, and can be shared across threads.
+//       an instance created with caller's contexts (e.g. placed in a ZstdWorkspace)
+//       uses them for every call, and must not be shared across threads.
 class ZstdCodec
 {
 public:
+    ZstdCodec();
+    explicit ZstdCodec(ZstdContextPool& pool);
+    // NOTE: contexts must outlive the codec
+    ZstdCodec(CompressContext& cctx, DecompressContext& dctx);
+    // NOTE: contexts are created from `allocator`, which must outlive the codec
+    explicit ZstdCodec(IZstdAllocator& allocator);
+    ~ZstdCodec();
+
+    // NOTE: results report 64-bit sizes, failures are reported by ZstdResult::error.
+
     // information api
-    int CompressBound(usize src_size) const;
-    int ContentSize(const Vec<u8>& src) const;
+    ZstdResult CompressBound(usize src_size) const;
+    ZstdResult ContentSize(const Vec<u8>& src) const;
+    ZstdResult ContentSize(const u8* src, usize src_size) const;
+
+    // NOTE: total content size of concatenated frames (skippable frames count as 0),
+    //       requires content size in every frame header.
+    ZstdResult DecompressedSize(const Vec<u8>& src) const;
+    ZstdResult DecompressedSize(const u8* src, usize src_size) const;
+
+    // NOTE: `src` may hold only the first bytes of a frame, returns the header size,
+    //       or ZstdError::SrcSizeTooSmall with bytes required to parse the header.
+    ZstdResult FrameInfo(ZstdFrameInfo& info, const Vec<u8>& src) const;
+    ZstdResult FrameInfo(ZstdFrameInfo& info, const u8* src, usize src_size) const;
 
     // simple api
-    int Compress(Vec<u8>& dest, const Vec<u8>& src, int compression_level) const;
-    int Decompress(Vec<u8>& dest, const Vec<u8>& src) const;
+    ZstdResult Compress(Vec<u8>& dest, const Vec<u8>& src, int compression_level) const;
+    ZstdResult Compress(u8* dest, usize dest_size, const u8* src, usize src_size, int compression_level) const;
+    ZstdResult Decompress(Vec<u8>& dest, const Vec<u8>& src) const;
+    ZstdResult Decompress(u8* dest, usize dest_size, const u8* src, usize src_size) const;
+
+    // NOTE: ByteBuffer versions size `dest` by themselves (without zero-fill),
+    //       decompression accepts concatenated frames and requires content size
+    //       in every frame header.
+    ZstdResult Compress(ByteBuffer& dest, const u8* src, usize src_size, int compression_level) const;
+    ZstdResult Decompress(ByteBuffer& dest, const u8* src, usize src_size) const;
+
+    // advanced api, parameters are applied as-is on a fresh context
+    ZstdResult Compress(Vec<u8>& dest, const Vec<u8>& src, const ZstdCompressionParams& params) const;
+    ZstdResult Compress(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdCompressionParams& params) const;
+    ZstdResult Compress(ByteBuffer& dest, const u8* src, usize src_size, const ZstdCompressionParams& params) const;
+
+    // delta api, compress relative to a reference (prefix) such as a previous version of the content.
+    // NOTE: window covers the reference (patch-from), decompression needs the same reference.
+    //       the reference must be alive during the call, and applies to a single frame.
+    ZstdResult CompressUsingPrefix(u8* dest, usize dest_size, const u8* src, usize src_size, const u8* prefix, usize prefix_size, int compression_level) const;
+    ZstdResult CompressUsingPrefix(ByteBuffer& dest, const u8* src, usize src_size, const u8* prefix, usize prefix_size, int compression_level) const;
+    ZstdResult DecompressUsingPrefix(u8* dest, usize dest_size, const u8* src, usize src_size, const u8* prefix, usize prefix_size) const;
+    ZstdResult DecompressUsingPrefix(ByteBuffer& dest, const u8* src, usize src_size, const u8* prefix, usize prefix_size) const;
 
     // dictionary api
-    int CompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdCompressionDict& cdict) const;
-    int DecompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdDecompressionDict& ddict) const;
+    ZstdResult CompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdCompressionDict& cdict) const;
+    ZstdResult CompressUsingDict(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdCompressionDict& cdict) const;
+    ZstdResult DecompressUsingDict(Vec<u8>& dest, const Vec<u8>& src, const ZstdDecompressionDict& ddict) const;
+    ZstdResult DecompressUsingDict(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdDecompressionDict& ddict) const;
+    ZstdResult CompressUsingDict(ByteBuffer& dest, const u8* src, usize src_size, const ZstdCompressionDict& cdict) const;
+    ZstdResult DecompressUsingDict(ByteBuffer& dest, const u8* src, usize src_size, const ZstdDecompressionDict& ddict) const;
+
+    // NOTE: selects the dictionary of each frame by the dictID in its header, frames without
+    //       dictID are decoded without a dictionary. fails with ZSTD_error_dictionary_wrong
+    //       if a dictionary is not in `ddicts`.
+    ZstdResult DecompressUsingDicts(Vec<u8>& dest, const Vec<u8>& src, const ZstdDecompressionDictSet& ddicts) const;
+    ZstdResult DecompressUsingDicts(u8* dest, usize dest_size, const u8* src, usize src_size, const ZstdDecompressionDictSet& ddicts) const;
+    ZstdResult DecompressUsingDicts(ByteBuffer& dest, const u8* src, usize src_size, const ZstdDecompressionDictSet& ddicts) const;
+
+    // NOTE: observer must outlive the codec, nullptr to detach.
+    void SetDictObserver(IDictCompressionObserver* observer);
+
+private:
+    CompressContextLease AcquireCompressContext() const;
+    DecompressContextLease AcquireDecompressContext() const;
+
+    ZstdContextPool*                            pool_;
+    IDictCompressionObserver*                   dict_observer_;
+    IZstdAllocator*                             allocator_;
+    CompressContext*                            external_cctx_;
+    DecompressContext*                          external_dctx_;
+    mutable std::unique_ptr<CompressContext>    cctx_;
+    mutable std::unique_ptr<DecompressContext>  dctx_;
 };
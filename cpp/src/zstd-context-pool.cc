@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "zstd-context-pool.h"
+
+
+static u64 NextFreeListId()
+{
+    static std::atomic<u64> s_next_id(1);
+    return s_next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+//
+// ZstdContextPool::FreeList
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// NOTE: `context` is only touched by the thread holding the slot. `owner` is cleared
+//       by either the thread exit or the pool destruction, whichever comes first.
+template <typename Context>
+struct ZstdContextPool::FreeList<Context>::Slot
+{
+    std::mutex                  mutex;
+    FreeList*                   owner;
+    std::unique_ptr<Context>    context;
+};
+
+
+// slots of a thread keyed by free-list id, released on thread exit.
+template <typename Context>
+struct ZstdContextPool::FreeList<Context>::ThreadSlots
+{
+    ~ThreadSlots()
+    {
+        Exiting() = true;
+        for (auto& entry : slots) {
+            ReleaseSlot(*entry.second);
+        }
+    }
+
+    // NOTE: null while the thread exits, thread_local objects may be destroyed already
+    static ThreadSlots* Current()
+    {
+        if (Exiting()) return nullptr;
+
+        static thread_local ThreadSlots s_slots;
+        return &s_slots;
+    }
+
+    static bool& Exiting()
+    {
+        static thread_local bool s_exiting = false;
+        return s_exiting;
+    }
+
+    // NOTE: drops slots released by destroyed pools
+    void Prune()
+    {
+        for (auto it = std::begin(slots); it != std::end(slots); ) {
+            std::unique_lock<std::mutex> lock(it->second->mutex);
+            const auto released = it->second->owner == nullptr;
+            lock.unlock();
+
+            it = released ? slots.erase(it) : std::next(it);
+        }
+    }
+
+    std::unordered_map<u64, std::shared_ptr<Slot>> slots;
+};
+
+
+template <typename Context>
+ZstdContextPool::FreeList<Context>::FreeList(usize capacity)
+    : id_(NextFreeListId())
+    , capacity_(capacity)
+    , mutex_()
+    , contexts_()
+    , thread_slots_()
+    , hits_(0)
+    , misses_(0)
+    , borrowed_(0)
+    , high_water_(0)
+{
+    contexts_.reserve(capacity);
+}
+
+
+template <typename Context>
+ZstdContextPool::FreeList<Context>::~FreeList()
+{
+    // NOTE: a thread may exit meanwhile, release slots outside of mutex_ as it does
+    Vec<std::shared_ptr<Slot>> thread_slots;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        thread_slots.swap(thread_slots_);
+    }
+
+    for (auto& slot : thread_slots) {
+        std::lock_guard<std::mutex> lock(slot->mutex);
+        slot->owner = nullptr;
+        slot->context.reset();
+    }
+
+    auto current = ThreadSlots::Current();
+    if (current != nullptr) current->slots.erase(id_);
+}
+
+
+template <typename Context>
+std::unique_ptr<Context> ZstdContextPool::FreeList<Context>::Pop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (contexts_.empty()) return nullptr;
+
+    auto context = std::move(contexts_.back());
+    contexts_.pop_back();
+    return context;
+}
+
+
+template <typename Context>
+void ZstdContextPool::FreeList<Context>::Push(std::unique_ptr<Context> context)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    PushLocked(std::move(context));
+}
+
+
+template <typename Context>
+void ZstdContextPool::FreeList<Context>::PushLocked(std::unique_ptr<Context> context)
+{
+    // NOTE: thread slots count against capacity, whether they hold a context or not
+    if (context != nullptr && contexts_.size() + thread_slots_.size() < capacity_) {
+        contexts_.push_back(std::move(context));
+    }
+
+    // NOTE: context is destroyed here when the free-list is full
+}
+
+
+template <typename Context>
+std::unique_ptr<Context>* ZstdContextPool::FreeList<Context>::ThreadSlot()
+{
+    auto current = ThreadSlots::Current();
+    if (current == nullptr) return nullptr;
+
+    const auto found = current->slots.find(id_);
+    if (found != std::end(current->slots)) return &found->second->context;
+
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (thread_slots_.size() >= capacity_) return nullptr;
+
+        slot = std::make_shared<Slot>();
+        slot->owner = this;
+        thread_slots_.push_back(slot);
+    }
+
+    current->Prune();
+    current->slots.emplace(id_, slot);
+    return &slot->context;
+}
+
+
+template <typename Context>
+void ZstdContextPool::FreeList<Context>::ReleaseSlot(Slot& slot)
+{
+    std::lock_guard<std::mutex> slot_lock(slot.mutex);
+    if (slot.owner == nullptr) return;
+
+    auto& owner = *slot.owner;
+    std::lock_guard<std::mutex> lock(owner.mutex_);
+
+    const auto found = std::find_if(std::begin(owner.thread_slots_), std::end(owner.thread_slots_),
+                                    [&slot](const std::shared_ptr<Slot>& thread_slot) { return thread_slot.get() == &slot; });
+    if (found != std::end(owner.thread_slots_)) owner.thread_slots_.erase(found);
+
+    owner.PushLocked(std::move(slot.context));
+    slot.owner = nullptr;
+}
+
+
+template <typename Context>
+void ZstdContextPool::FreeList<Context>::OnBorrow(bool hit)
+{
+    auto& counter = hit ? hits_ : misses_;
+    counter.fetch_add(1, std::memory_order_relaxed);
+
+    const auto borrowed = borrowed_.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto high_water = high_water_.load(std::memory_order_relaxed);
+    while (borrowed > high_water &&
+           !high_water_.compare_exchange_weak(high_water, borrowed, std::memory_order_relaxed)) {
+    }
+}
+
+
+template <typename Context>
+void ZstdContextPool::FreeList<Context>::OnReturn()
+{
+    borrowed_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+
+template <typename Context>
+ZstdContextPoolStats ZstdContextPool::FreeList<Context>::Stats() const
+{
+    return ZstdContextPoolStats {
+        hits_.load(std::memory_order_relaxed),
+        misses_.load(std::memory_order_relaxed),
+        high_water_.load(std::memory_order_relaxed),
+    };
+}
+
+
+//
+// ZstdContextPool
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdContextPool::ZstdContextPool(usize capacity, bool use_thread_cache)
+    : use_thread_cache_(use_thread_cache)
+    , cctx_list_(capacity)
+    , dctx_list_(capacity)
+{
+}
+
+
+ZstdContextPool::~ZstdContextPool()
+{
+}
+
+
+CompressContextLease ZstdContextPool::BorrowCompressContext()
+{
+    return Borrow(cctx_list_);
+}
+
+
+DecompressContextLease ZstdContextPool::BorrowDecompressContext()
+{
+    return Borrow(dctx_list_);
+}
+
+
+ZstdContextPoolStats ZstdContextPool::CompressStats() const
+{
+    return cctx_list_.Stats();
+}
+
+
+ZstdContextPoolStats ZstdContextPool::DecompressStats() const
+{
+    return dctx_list_.Stats();
+}
+
+
+template <typename Context>
+ContextLease<Context> ZstdContextPool::Borrow(FreeList<Context>& free_list)
+{
+    std::unique_ptr<Context> context;
+    if (use_thread_cache_) {
+        const auto slot = free_list.ThreadSlot();
+        if (slot != nullptr) context = std::move(*slot);
+    }
+
+    if (context == nullptr) {
+        context = free_list.Pop();
+    }
+
+    const auto hit = context != nullptr;
+    if (!hit) {
+        context.reset(new Context());
+        if (context->fail()) return ContextLease<Context>();
+    }
+
+    // NOTE: previous borrower may have left parameters on the context
+    if (!context->Reset()) return ContextLease<Context>();
+
+    free_list.OnBorrow(hit);
+    return ContextLease<Context>(context.release(), ContextReleaser<Context>(this));
+}
+
+
+template <typename Context>
+void ZstdContextPool::Return(FreeList<Context>& free_list, Context* context)
+{
+    std::unique_ptr<Context> owned(context);
+    free_list.OnReturn();
+
+    if (use_thread_cache_) {
+        const auto slot = free_list.ThreadSlot();
+        if (slot != nullptr && *slot == nullptr) {
+            *slot = std::move(owned);
+            return;
+        }
+    }
+
+    free_list.Push(std::move(owned));
+}
+
+
+void ZstdContextPool::Return(CompressContext* context)
+{
+    Return(cctx_list_, context);
+}
+
+
+void ZstdContextPool::Return(DecompressContext* context)
+{
+    Return(dctx_list_, context);
+}
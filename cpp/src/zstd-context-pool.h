@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "common-types.h"
+#include "zstd-context.h"
+
+
+class ZstdContextPool;
+
+
+// NOTE: returns a borrowed context to its pool, or does nothing when the context
+//       is not owned by any pool.
+template <typename Context>
+class ContextReleaser
+{
+public:
+    ContextReleaser() : pool_(nullptr) {}
+    explicit ContextReleaser(ZstdContextPool* pool) : pool_(pool) {}
+
+    void operator()(Context* context) const;
+
+private:
+    ZstdContextPool*    pool_;
+};
+
+
+// NOTE: a lease must be released before its pool is destroyed.
+template <typename Context>
+using ContextLease = std::unique_ptr<Context, ContextReleaser<Context>>;
+
+using CompressContextLease = ContextLease<CompressContext>;
+using DecompressContextLease = ContextLease<DecompressContext>;
+
+
+struct ZstdContextPoolStats
+{
+    usize   hits;           // borrowed from thread cache or free-list
+    usize   misses;         // newly created contexts
+    usize   high_water;     // max number of contexts borrowed at the same time
+};
+
+
+// Thread-safe, bounded pool of reusable compression/decompression contexts.
+//
+// Borrowing first looks at this pool's per-thread cache slot (no locking), then
+// at the shared free-list. Returned contexts go back to the per-thread slot when
+// it is empty, otherwise to the free-list. At most `capacity` contexts are kept
+// idle, in per-thread slots and the free-list together, others are destroyed.
+//
+// NOTE: up to `capacity` threads get a slot, a slot is released on thread exit and
+//       its context goes back to the free-list. the pool must outlive its leases.
+class ZstdContextPool
+{
+public:
+    explicit ZstdContextPool(usize capacity, bool use_thread_cache = true);
+    ~ZstdContextPool();
+
+    ZstdContextPool(const ZstdContextPool&) = delete;
+    ZstdContextPool& operator=(const ZstdContextPool&) = delete;
+
+    // NOTE: returns null lease when a context cannot be allocated
+    CompressContextLease BorrowCompressContext();
+    DecompressContextLease BorrowDecompressContext();
+
+    ZstdContextPoolStats CompressStats() const;
+    ZstdContextPoolStats DecompressStats() const;
+
+private:
+    template <typename Context> friend class ContextReleaser;
+
+    template <typename Context>
+    class FreeList
+    {
+    public:
+        explicit FreeList(usize capacity);
+        ~FreeList();
+
+        std::unique_ptr<Context> Pop();
+        void Push(std::unique_ptr<Context> context);
+
+        // NOTE: slot of the calling thread, only touched by that thread.
+        //       null when `capacity` threads already have a slot.
+        std::unique_ptr<Context>* ThreadSlot();
+
+        void OnBorrow(bool hit);
+        void OnReturn();
+        ZstdContextPoolStats Stats() const;
+
+    private:
+        struct Slot;
+        struct ThreadSlots;
+
+        static void ReleaseSlot(Slot& slot);
+        void PushLocked(std::unique_ptr<Context> context);
+
+        const u64                           id_;
+        const usize                         capacity_;
+        std::mutex                          mutex_;
+        Vec<std::unique_ptr<Context>>       contexts_;
+        Vec<std::shared_ptr<Slot>>          thread_slots_;
+
+        std::atomic<usize>  hits_;
+        std::atomic<usize>  misses_;
+        std::atomic<usize>  borrowed_;
+        std::atomic<usize>  high_water_;
+    };
+
+    template <typename Context>
+    ContextLease<Context> Borrow(FreeList<Context>& free_list);
+
+    template <typename Context>
+    void Return(FreeList<Context>& free_list, Context* context);
+
+    void Return(CompressContext* context);
+    void Return(DecompressContext* context);
+
+    const bool                      use_thread_cache_;
+    FreeList<CompressContext>       cctx_list_;
+    FreeList<DecompressContext>     dctx_list_;
+};
+
+
+template <typename Context>
+void ContextReleaser<Context>::operator()(Context* context) const
+{
+    if (pool_ != nullptr) pool_->Return(context);
+}
@@ -0,0 +1,105 @@
+#include "zstd-allocator-internal.h"
+#include "zstd-context.h"
+
+
+static void CloseCCtx(ZSTD_CCtx_s* cctx)
+{
+    ZSTD_freeCCtx(cctx);
+}
+
+
+static void CloseDCtx(ZSTD_DCtx_s* dctx)
+{
+    ZSTD_freeDCtx(dctx);
+}
+
+
+//
+// CompressContext
+//
+////////////////////////////////////////////////////////////////////////////////
+
+CompressContext::CompressContext()
+    : Resource(ZSTD_createCCtx(), CloseCCtx)
+{
+}
+
+
+CompressContext::CompressContext(ZstdWorkspace workspace)
+    : Resource(ZSTD_initStaticCCtx(workspace.data, workspace.size), CloseStatic<ZSTD_CCtx_s>)
+{
+}
+
+
+CompressContext::CompressContext(IZstdAllocator& allocator)
+    : Resource(ZSTD_createCCtx_advanced(ToCustomMem(&allocator)), CloseCCtx)
+{
+}
+
+
+usize CompressContext::EstimateSize(int compression_level, u64 src_size_hint)
+{
+    if (src_size_hint == 0) return ZSTD_estimateCCtxSize(compression_level);
+
+    const auto cparams = ZSTD_getCParams(compression_level, src_size_hint, 0);
+    return ZSTD_estimateCCtxSize_usingCParams(cparams);
+}
+
+
+bool CompressContext::fail() const
+{
+    return get() == nullptr;
+}
+
+
+bool CompressContext::Reset()
+{
+    if (fail()) return false;
+
+    const auto rc = ZSTD_CCtx_reset(get(), ZSTD_reset_session_and_parameters);
+    return !ZSTD_isError(rc);
+}
+
+
+//
+// DecompressContext
+//
+////////////////////////////////////////////////////////////////////////////////
+
+DecompressContext::DecompressContext()
+    : Resource(ZSTD_createDCtx(), CloseDCtx)
+{
+}
+
+
+DecompressContext::DecompressContext(ZstdWorkspace workspace)
+    : Resource(ZSTD_initStaticDCtx(workspace.data, workspace.size), CloseStatic<ZSTD_DCtx_s>)
+{
+}
+
+
+DecompressContext::DecompressContext(IZstdAllocator& allocator)
+    : Resource(ZSTD_createDCtx_advanced(ToCustomMem(&allocator)), CloseDCtx)
+{
+}
+
+
+usize DecompressContext::EstimateSize()
+{
+    return ZSTD_estimateDCtxSize();
+}
+
+
+bool DecompressContext::fail() const
+{
+    return get() == nullptr;
+}
+
+
+bool DecompressContext::Reset()
+{
+    if (fail()) return false;
+
+    const auto rc = ZSTD_DCtx_reset(get(), ZSTD_reset_session_and_parameters);
+    return !ZSTD_isError(rc);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common-types.h"
+#include "raii-resource.h"
+
+
+extern "C" {
+struct ZSTD_CCtx_s;     // original struct of ZSTD_CCtx
+struct ZSTD_DCtx_s;     // original struct of ZSTD_DCtx
+}
+
+
+class IZstdAllocator;
+
+
+// Caller-provided memory to place a zstd object in (ZSTD_initStatic*), size it with
+// the EstimateSize helpers of each class.
+//
+// NOTE: must be 8-byte aligned and outlive the object placed in it. objects placed in
+//       a workspace never allocate, operations needing more memory fail instead.
+struct ZstdWorkspace
+{
+    void*   data;
+    usize   size;
+};
+
+
+class CompressContext : public Resource<ZSTD_CCtx_s>
+{
+public:
+    CompressContext();
+    explicit CompressContext(ZstdWorkspace workspace);
+    explicit CompressContext(IZstdAllocator& allocator);
+
+    // NOTE: workspace size to compress at `compression_level`. `src_size_hint` (0 if unknown)
+    //       allows a smaller workspace, larger inputs may then fail to compress.
+    static usize EstimateSize(int compression_level, u64 src_size_hint = 0);
+
+    bool fail() const;
+
+    // NOTE: drop session state and sticky parameters, keep allocated workspace
+    bool Reset();
+};
+
+
+class DecompressContext : public Resource<ZSTD_DCtx_s>
+{
+public:
+    DecompressContext();
+    explicit DecompressContext(ZstdWorkspace workspace);
+    explicit DecompressContext(IZstdAllocator& allocator);
+
+    // NOTE: workspace size for one-shot decompression, streaming needs more
+    static usize EstimateSize();
+
+    bool fail() const;
+
+    // NOTE: drop session state and sticky parameters, keep allocated workspace
+    bool Reset();
+};
@@ -0,0 +1,318 @@
+#include <chrono>
+#include <limits>
+
+#include "zstd.h"
+#include "zstd-dict-registry.h"
+
+
+static const int kDecompressionKey = std::numeric_limits<int>::min();
+
+
+struct DictCacheKey
+{
+    u64 registry_id;
+    u32 dict_id;
+    int key;    // compression level, or kDecompressionKey
+
+    bool operator==(const DictCacheKey& other) const
+    {
+        return registry_id == other.registry_id && dict_id == other.dict_id && key == other.key;
+    }
+};
+
+
+struct DictCacheKeyHash
+{
+    usize operator()(const DictCacheKey& k) const
+    {
+        auto h = k.registry_id * 0x9E3779B97F4A7C15ull;
+        h ^= (static_cast<u64>(k.dict_id) << 32) | static_cast<u32>(k.key);
+        h *= 0xFF51AFD7ED558CCDull;
+        return static_cast<usize>(h ^ (h >> 32));
+    }
+};
+
+
+// NOTE: weak references, so a per-thread cache never keeps a dictionary alive.
+//       entries of retired or destroyed slots fail to lock and are refreshed
+//       from the registry on next lookup.
+template <typename Slot>
+static std::unordered_map<DictCacheKey, std::weak_ptr<Slot>, DictCacheKeyHash>& ThreadCache()
+{
+    static thread_local std::unordered_map<DictCacheKey, std::weak_ptr<Slot>, DictCacheKeyHash> s_cache;
+    return s_cache;
+}
+
+
+static u64 NextRegistryId()
+{
+    static std::atomic<u64> s_next_id(1);
+    return s_next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+static u64 MonotonicNs()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+
+static usize SizeOf(const ZstdCompressionDict& dict)
+{
+    return ZSTD_sizeof_CDict(dict.get());
+}
+
+
+static usize SizeOf(const ZstdDecompressionDict& dict)
+{
+    return ZSTD_sizeof_DDict(dict.get());
+}
+
+
+//
+// ZstdDictRegistry::DictSlot
+//
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Dict>
+template <typename... Args>
+ZstdDictRegistry::DictSlot<Dict>::DictSlot(Args&&... args)
+    : dict(std::forward<Args>(args)...)
+    , memory(dict.fail() ? 0 : SizeOf(dict))
+    , last_used(MonotonicNs())
+    , retired(false)
+{
+}
+
+
+//
+// ZstdDictRegistry
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdDictRegistry::ZstdDictRegistry(usize memory_budget)
+    : id_(NextRegistryId())
+    , memory_budget_(memory_budget)
+    , mutex_()
+    , entries_()
+    , digested_(0)
+    , memory_usage_(0)
+    , created_(0)
+    , evictions_(0)
+{
+}
+
+
+ZstdDictRegistry::~ZstdDictRegistry()
+{
+}
+
+
+u32 ZstdDictRegistry::Register(const Vec<u8>& dict_bytes)
+{
+    // NOTE: a single copy shared by every digested dictionary of the id
+    auto bytes = std::make_shared<const Vec<u8>>(dict_bytes);
+    return Register(bytes->data(), bytes->size(), bytes);
+}
+
+
+u32 ZstdDictRegistry::Register(std::shared_ptr<const MappedFile> file)
+{
+    if (file->fail()) return 0;
+    return Register(file->data(), file->size(), file);
+}
+
+
+u32 ZstdDictRegistry::Register(const u8* dict_bytes, usize dict_size, std::shared_ptr<const void> owner)
+{
+    const auto dict_id = ZSTD_getDictID_fromDict(dict_bytes, dict_size);
+    if (dict_id == 0) return 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(dict_id) > 0) return 0;
+
+    auto& entry = entries_[dict_id];
+    entry.owner = std::move(owner);
+    entry.dict_bytes = dict_bytes;
+    entry.dict_size = dict_size;
+    return dict_id;
+}
+
+
+bool ZstdDictRegistry::Unregister(u32 dict_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(dict_id);
+    if (it == entries_.end()) return false;
+
+    auto& entry = it->second;
+    Retire(entry.ddict);
+    for (auto& cdict : entry.cdicts) {
+        Retire(cdict.second);
+    }
+
+    entries_.erase(it);
+    return true;
+}
+
+
+bool ZstdDictRegistry::Contains(u32 dict_id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(dict_id) > 0;
+}
+
+
+ZstdCompressionDictHandle ZstdDictRegistry::CompressionDict(u32 dict_id, int compression_level)
+{
+    // NOTE: levels are cache keys, negative levels are not supported
+    if (compression_level < 0 || compression_level > ZSTD_maxCLevel()) return nullptr;
+
+    const auto select = [compression_level](Entry& entry) -> std::shared_ptr<CDictSlot>& {
+        return entry.cdicts[compression_level];
+    };
+
+    auto slot = Find<CDictSlot>(dict_id, compression_level, select, compression_level);
+    if (!slot) return nullptr;
+
+    // NOTE: aliasing constructor, the handle keeps the whole slot alive
+    return ZstdCompressionDictHandle(slot, &slot->dict);
+}
+
+
+ZstdDecompressionDictHandle ZstdDictRegistry::DecompressionDict(u32 dict_id)
+{
+    const auto select = [](Entry& entry) -> std::shared_ptr<DDictSlot>& {
+        return entry.ddict;
+    };
+
+    auto slot = Find<DDictSlot>(dict_id, kDecompressionKey, select);
+    if (!slot) return nullptr;
+
+    return ZstdDecompressionDictHandle(slot, &slot->dict);
+}
+
+
+ZstdDictRegistryStats ZstdDictRegistry::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ZstdDictRegistryStats {
+        entries_.size(),
+        digested_,
+        memory_usage_,
+        created_,
+        evictions_,
+    };
+}
+
+
+template <typename Slot, typename Select, typename... Args>
+std::shared_ptr<Slot> ZstdDictRegistry::Find(u32 dict_id, int key, Select select, Args... args)
+{
+    // fast path: digested dictionary cached by this thread, no locking
+    auto& cache = ThreadCache<Slot>();
+    const DictCacheKey cache_key { id_, dict_id, key };
+    const auto cached = cache.find(cache_key);
+    if (cached != cache.end()) {
+        auto slot = cached->second.lock();
+        if (slot && !slot->retired.load(std::memory_order_acquire)) {
+            slot->last_used.store(MonotonicNs(), std::memory_order_relaxed);
+            return slot;
+        }
+    }
+
+    std::shared_ptr<const void> owner;
+    const u8* dict_bytes = nullptr;
+    usize dict_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(dict_id);
+        if (it == entries_.end()) return nullptr;
+
+        auto& slot = select(it->second);
+        if (slot) {
+            slot->last_used.store(MonotonicNs(), std::memory_order_relaxed);
+            cache[cache_key] = slot;
+            return slot;
+        }
+
+        owner = it->second.owner;
+        dict_bytes = it->second.dict_bytes;
+        dict_size = it->second.dict_size;
+    }
+
+    // NOTE: digesting may take milliseconds on high levels, do it without the lock
+    auto created = std::make_shared<Slot>(dict_bytes, dict_size, args..., std::move(owner));
+    if (created->dict.fail()) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(dict_id);
+    if (it == entries_.end()) return nullptr;   // unregistered while digesting
+
+    auto& slot = select(it->second);
+    if (!slot) {
+        // NOTE: no other thread has digested it meanwhile
+        slot = created;
+        digested_ += 1;
+        memory_usage_ += created->memory;
+        created_ += 1;
+        EvictOver(memory_budget_, created.get());
+    }
+
+    cache[cache_key] = slot;
+    return slot;
+}
+
+
+template <typename Slot>
+void ZstdDictRegistry::Retire(std::shared_ptr<Slot>& slot)
+{
+    if (!slot) return;
+
+    slot->retired.store(true, std::memory_order_release);
+    digested_ -= 1;
+    memory_usage_ -= slot->memory;
+    slot.reset();
+}
+
+
+void ZstdDictRegistry::EvictOver(usize memory_budget, const void* keep)
+{
+    while (memory_usage_ > memory_budget) {
+        std::shared_ptr<CDictSlot>* lru_cdict = nullptr;
+        std::shared_ptr<DDictSlot>* lru_ddict = nullptr;
+        auto lru_time = std::numeric_limits<u64>::max();
+
+        for (auto& entry : entries_) {
+            auto& ddict = entry.second.ddict;
+            if (ddict && ddict.get() != keep) {
+                const auto used = ddict->last_used.load(std::memory_order_relaxed);
+                if (used < lru_time) {
+                    lru_time = used;
+                    lru_ddict = &ddict;
+                    lru_cdict = nullptr;
+                }
+            }
+
+            for (auto& level_cdict : entry.second.cdicts) {
+                auto& cdict = level_cdict.second;
+                if (!cdict || cdict.get() == keep) continue;
+
+                const auto used = cdict->last_used.load(std::memory_order_relaxed);
+                if (used < lru_time) {
+                    lru_time = used;
+                    lru_cdict = &cdict;
+                    lru_ddict = nullptr;
+                }
+            }
+        }
+
+        // NOTE: a single dictionary over the budget is kept, it is in use right now
+        if (lru_cdict == nullptr && lru_ddict == nullptr) break;
+
+        if (lru_cdict != nullptr) Retire(*lru_cdict);
+        if (lru_ddict != nullptr) Retire(*lru_ddict);
+        evictions_ += 1;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "common-types.h"
+#include "zstd-dict.h"
+
+
+struct ZstdDictRegistryStats
+{
+    usize   dicts;          // registered dictionaries
+    usize   digested;       // CDicts and DDicts held by the registry
+    usize   memory_usage;   // bytes of CDicts and DDicts held by the registry
+    usize   created;
+    usize   evictions;
+};
+
+
+// Thread-safe registry of dictionaries keyed by dictID.
+//
+// CDicts (per compression level) and DDicts are digested on first use and shared
+// by all threads. Lookups of digested dictionaries go through a per-thread cache
+// (no locking), the registry lock is taken only to create or evict them.
+// Least recently used CDicts and DDicts are evicted while their total size exceeds
+// `memory_budget`, and are digested again on next use.
+class ZstdDictRegistry
+{
+public:
+    explicit ZstdDictRegistry(usize memory_budget);
+    ~ZstdDictRegistry();
+
+    ZstdDictRegistry(const ZstdDictRegistry&) = delete;
+    ZstdDictRegistry& operator=(const ZstdDictRegistry&) = delete;
+
+    // NOTE: returns dictID of `dict_bytes`, or 0 when bytes are not a zstd dictionary
+    //       (raw content dictionaries have no id) or the id is already registered.
+    u32 Register(const Vec<u8>& dict_bytes);
+    // NOTE: dictionaries are digested by reference, the registry keeps `file` mapped
+    //       until the dictionary is unregistered and no handle refers to it.
+    u32 Register(std::shared_ptr<const MappedFile> file);
+    bool Unregister(u32 dict_id);
+    bool Contains(u32 dict_id) const;
+
+    // NOTE: return null handle when `dict_id` is not registered or digesting fails.
+    //       a dictionary stays valid while a handle is alive, even after it has been
+    //       evicted or unregistered.
+    ZstdCompressionDictHandle CompressionDict(u32 dict_id, int compression_level);
+    ZstdDecompressionDictHandle DecompressionDict(u32 dict_id);
+
+    ZstdDictRegistryStats Stats() const;
+
+private:
+    template <typename Dict>
+    struct DictSlot
+    {
+        template <typename... Args>
+        explicit DictSlot(Args&&... args);
+
+        Dict                dict;
+        usize               memory;
+        std::atomic<u64>    last_used;
+        std::atomic<bool>   retired;    // dropped by the registry, per-thread caches must not use it
+    };
+
+    using CDictSlot = DictSlot<ZstdCompressionDict>;
+    using DDictSlot = DictSlot<ZstdDecompressionDict>;
+
+    struct Entry
+    {
+        std::shared_ptr<const void>             owner;      // keeps dict bytes alive
+        const u8*                               dict_bytes;
+        usize                                   dict_size;
+        std::shared_ptr<DDictSlot>              ddict;
+        std::map<int, std::shared_ptr<CDictSlot>> cdicts;   // by compression level
+    };
+
+    template <typename Slot, typename Select, typename... Args>
+    std::shared_ptr<Slot> Find(u32 dict_id, int key, Select select, Args... args);
+
+    u32 Register(const u8* dict_bytes, usize dict_size, std::shared_ptr<const void> owner);
+
+    template <typename Slot>
+    void Retire(std::shared_ptr<Slot>& slot);
+    void EvictOver(usize memory_budget, const void* keep);
+
+    const u64                       id_;        // distinguishes registries in per-thread caches
+    const usize                     memory_budget_;
+
+    mutable std::mutex              mutex_;
+    std::unordered_map<u32, Entry>  entries_;
+    usize                           digested_;
+    usize                           memory_usage_;
+    usize                           created_;
+    usize                           evictions_;
+};
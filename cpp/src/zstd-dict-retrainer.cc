@@ -0,0 +1,175 @@
+#include <cmath>
+
+#include "zstd.h"
+#include "zstd-dict-retrainer.h"
+#include "zstd-dict-trainer.h"
+
+
+//
+// ZstdDictRetrainOptions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdDictRetrainOptions::ZstdDictRetrainOptions()
+    : sample_rate(0.01)
+    , min_ratio(2.0)
+    , window_samples(1000)
+    , max_sample_bytes(100 * ZstdDictTrainer::kDefaultDictCapacity)  // NOTE: zdict recommends ~100x dict size
+    , dict_capacity(ZstdDictTrainer::kDefaultDictCapacity)
+    , compression_level(3)
+{
+}
+
+
+//
+// ZstdDictRetrainer
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdDictRetrainer::ZstdDictRetrainer(ZstdDictRegistry& registry, u32 dict_id, const ZstdDictRetrainOptions& options)
+    : registry_(registry)
+    , options_(options)
+    , dict_id_(dict_id)
+    , payloads_(0)
+    , mutex_()
+    , windows_()
+    , samples_()
+    , samples_size_(0)
+    , sampled_(0)
+    , retrains_(0)
+    , published_(0)
+    , training_(false)
+    , worker_mutex_()
+    , worker_()
+{
+}
+
+
+ZstdDictRetrainer::~ZstdDictRetrainer()
+{
+    Wait();
+}
+
+
+ZstdCompressionDictHandle ZstdDictRetrainer::CompressionDict() const
+{
+    return registry_.CompressionDict(DictId(), options_.compression_level);
+}
+
+
+u32 ZstdDictRetrainer::DictId() const
+{
+    return dict_id_.load(std::memory_order_acquire);
+}
+
+
+double ZstdDictRetrainer::Ratio(u32 dict_id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = windows_.find(dict_id);
+    return it != windows_.end() ? it->second.ratio : 0.0;
+}
+
+
+ZstdDictRetrainStats ZstdDictRetrainer::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ZstdDictRetrainStats {
+        sampled_,
+        retrains_,
+        published_,
+        DictId(),
+    };
+}
+
+
+void ZstdDictRetrainer::Wait()
+{
+    std::lock_guard<std::mutex> lock(worker_mutex_);
+    if (worker_.joinable()) worker_.join();
+}
+
+
+void ZstdDictRetrainer::OnCompressUsingDict(const ZstdCompressionDict& cdict, const u8* src, usize src_size, usize compressed_size)
+{
+    if (!ShouldSample()) return;
+
+    const auto dict_id = ZSTD_getDictID_fromCDict(cdict.get());
+    Vec<Vec<u8>> retrain_samples;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sampled_ += 1;
+
+        samples_.emplace_back(src, src + src_size);
+        samples_size_ += src_size;
+        while (samples_size_ > options_.max_sample_bytes && samples_.size() > 1) {
+            samples_size_ -= samples_.front().size();
+            samples_.pop_front();
+        }
+
+        auto& window = windows_[dict_id];
+        window.content_size += src_size;
+        window.compressed_size += compressed_size;
+        window.samples += 1;
+        if (window.samples < options_.window_samples) return;
+
+        window.ratio = static_cast<double>(window.content_size) / static_cast<double>(window.compressed_size);
+        window.content_size = 0;
+        window.compressed_size = 0;
+        window.samples = 0;
+
+        // NOTE: windows of previous dictionaries (still in use by other codecs) never trigger retraining
+        if (dict_id != DictId() || window.ratio >= options_.min_ratio) return;
+
+        auto expected = false;
+        if (!training_.compare_exchange_strong(expected, true)) return;
+
+        retrain_samples.assign(samples_.begin(), samples_.end());
+        retrains_ += 1;
+    }
+
+    // NOTE: outside of `mutex_`, the finishing worker may need it to publish
+    StartRetrain(std::move(retrain_samples));
+}
+
+
+bool ZstdDictRetrainer::ShouldSample()
+{
+    // NOTE: deterministic, every (1 / sample_rate)-th payload on average
+    const auto n = static_cast<double>(payloads_.fetch_add(1, std::memory_order_relaxed));
+    return std::floor((n + 1.0) * options_.sample_rate) > std::floor(n * options_.sample_rate);
+}
+
+
+void ZstdDictRetrainer::StartRetrain(Vec<Vec<u8>> samples)
+{
+    std::lock_guard<std::mutex> lock(worker_mutex_);
+
+    // NOTE: previous worker has finished its job (`training_` was false)
+    if (worker_.joinable()) worker_.join();
+
+    worker_ = std::thread([this, samples = std::move(samples)]() {
+        Retrain(samples);
+        training_.store(false, std::memory_order_release);
+    });
+}
+
+
+void ZstdDictRetrainer::Retrain(const Vec<Vec<u8>>& samples)
+{
+    ZstdDictTrainer trainer(options_.dict_capacity);
+    for (const auto& sample : samples) {
+        trainer.AddSample(sample);
+    }
+
+    Vec<u8> dict_bytes;
+    if (!trainer.Train(dict_bytes).ok()) return;
+
+    // NOTE: fails on a dictID collision, the next low-ratio window retries
+    const auto dict_id = registry_.Register(dict_bytes);
+    if (dict_id == 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    published_ += 1;
+    dict_id_.store(dict_id, std::memory_order_release);
+}
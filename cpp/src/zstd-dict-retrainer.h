@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "common-types.h"
+#include "zstd-codec.h"
+#include "zstd-dict-registry.h"
+
+
+struct ZstdDictRetrainOptions
+{
+    double  sample_rate;        // fraction of payloads sampled, in (0, 1]
+    double  min_ratio;          // retrain when content / compressed size of a window drops below
+    usize   window_samples;     // sampled payloads per ratio window
+    usize   max_sample_bytes;   // most recent samples kept for training
+    usize   dict_capacity;
+    int     compression_level;
+
+    ZstdDictRetrainOptions();
+};
+
+
+struct ZstdDictRetrainStats
+{
+    usize   sampled;
+    usize   retrains;           // background trainings started
+    usize   published;          // dictionaries published by retraining
+    u32     dict_id;            // dictionary used for new compressions
+};
+
+
+// Retrains the dictionary of a payload stream when its compression ratio decays.
+//
+// Attach to ZstdCodec::SetDictObserver and compress with CompressionDict(). Sampled
+// payloads are kept, and the achieved ratio is tracked per dictionary over windows of
+// `window_samples` samples. When a window of the current dictionary falls below
+// `min_ratio`, a new dictionary is trained from recent samples on a background thread.
+// It is registered to `registry` and becomes current atomically, previous dictionaries
+// stay registered so their frames can still be decompressed.
+class ZstdDictRetrainer : public IDictCompressionObserver
+{
+public:
+    ZstdDictRetrainer(ZstdDictRegistry& registry, u32 dict_id, const ZstdDictRetrainOptions& options = ZstdDictRetrainOptions());
+    virtual ~ZstdDictRetrainer();
+
+    ZstdDictRetrainer(const ZstdDictRetrainer&) = delete;
+    ZstdDictRetrainer& operator=(const ZstdDictRetrainer&) = delete;
+
+    // NOTE: dictionary for new compressions at options' compression level
+    ZstdCompressionDictHandle CompressionDict() const;
+    u32 DictId() const;
+
+    // NOTE: ratio of the last complete window of `dict_id`, 0 if none yet
+    double Ratio(u32 dict_id) const;
+    ZstdDictRetrainStats Stats() const;
+
+    // NOTE: blocks until a running background training has published or failed
+    void Wait();
+
+    virtual void OnCompressUsingDict(const ZstdCompressionDict& cdict, const u8* src, usize src_size, usize compressed_size);
+
+private:
+    struct RatioWindow
+    {
+        u64     content_size;
+        u64     compressed_size;
+        usize   samples;
+        double  ratio;      // of the last complete window
+    };
+
+    bool ShouldSample();
+    void StartRetrain(Vec<Vec<u8>> samples);
+    void Retrain(const Vec<Vec<u8>>& samples);
+
+    ZstdDictRegistry&               registry_;
+    const ZstdDictRetrainOptions    options_;
+    std::atomic<u32>                dict_id_;
+    std::atomic<u64>                payloads_;
+
+    mutable std::mutex              mutex_;
+    std::unordered_map<u32, RatioWindow> windows_;
+    std::deque<Vec<u8>>             samples_;
+    usize                           samples_size_;
+    usize                           sampled_;
+    usize                           retrains_;
+    usize                           published_;
+
+    std::atomic<bool>               training_;
+    std::mutex                      worker_mutex_;  // NOTE: never taken by the worker
+    std::thread                     worker_;
+};
@@ -0,0 +1,105 @@
+#define ZDICT_STATIC_LINKING_ONLY
+
+#include <algorithm>
+
+#include "zdict.h"
+#include "zstd.h"
+#include "zstd_errors.h"
+#include "zstd-dict-trainer.h"
+
+
+static ZstdResult ToTrainResult(size_t rc, Vec<u8>& dict_bytes)
+{
+    if (ZDICT_isError(rc)) {
+        dict_bytes.clear();
+        return ZstdResult::Error(ZstdError::Zstd, ZSTD_getErrorCode(rc));
+    }
+
+    dict_bytes.resize(rc);
+    return ZstdResult::Ok(rc);
+}
+
+
+//
+// ZstdDictTrainer
+//
+////////////////////////////////////////////////////////////////////////////////
+
+const usize ZstdDictTrainer::kDefaultDictCapacity;
+
+
+ZstdDictTrainer::ZstdDictTrainer(usize dict_capacity)
+    : dict_capacity_(dict_capacity)
+    , samples_()
+    , sample_sizes_()
+{
+}
+
+
+ZstdDictTrainer::~ZstdDictTrainer()
+{
+}
+
+
+void ZstdDictTrainer::AddSample(const Vec<u8>& sample)
+{
+    AddSample(sample.data(), sample.size());
+}
+
+
+void ZstdDictTrainer::AddSample(const u8* sample, usize sample_size)
+{
+    samples_.append(sample, sample_size);
+    sample_sizes_.push_back(sample_size);
+}
+
+
+void ZstdDictTrainer::Clear()
+{
+    samples_.clear();
+    sample_sizes_.clear();
+}
+
+
+usize ZstdDictTrainer::DictCapacity() const
+{
+    return dict_capacity_;
+}
+
+
+usize ZstdDictTrainer::SampleCount() const
+{
+    return sample_sizes_.size();
+}
+
+
+usize ZstdDictTrainer::SamplesSize() const
+{
+    return samples_.size();
+}
+
+
+ZstdResult ZstdDictTrainer::Train(Vec<u8>& dict_bytes) const
+{
+    dict_bytes.resize(dict_capacity_);
+    const auto rc = ZDICT_trainFromBuffer(dict_bytes.data(), dict_bytes.size(),
+                                          samples_.data(), sample_sizes_.data(),
+                                          static_cast<unsigned>(sample_sizes_.size()));
+    return ToTrainResult(rc, dict_bytes);
+}
+
+
+ZstdResult ZstdDictTrainer::TrainOptimized(Vec<u8>& dict_bytes, int compression_level, u32 threads) const
+{
+    // NOTE: zero means zstd's default, `k` and `d` are searched
+    ZDICT_fastCover_params_t params {};
+    params.nbThreads = std::max<u32>(threads, 1);
+    params.zParams.compressionLevel = compression_level;
+
+    dict_bytes.resize(dict_capacity_);
+    const auto rc = ZDICT_optimizeTrainFromBuffer_fastCover(dict_bytes.data(), dict_bytes.size(),
+                                                            samples_.data(), sample_sizes_.data(),
+                                                            static_cast<unsigned>(sample_sizes_.size()),
+                                                            &params);
+    return ToTrainResult(rc, dict_bytes);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common-types.h"
+#include "zstd-result.h"
+
+
+// Trains dictionaries from samples collected in-process, trained bytes can be
+// loaded into ZstdCompressionDict and ZstdDecompressionDict as-is.
+//
+// NOTE: samples are copied, so callers may release them after AddSample.
+//       an instance must not be shared across threads.
+class ZstdDictTrainer
+{
+public:
+    // NOTE: same as `zstd --train` default (110 KiB)
+    static const usize kDefaultDictCapacity = 112640;
+
+    explicit ZstdDictTrainer(usize dict_capacity = kDefaultDictCapacity);
+    ~ZstdDictTrainer();
+
+    void AddSample(const Vec<u8>& sample);
+    void AddSample(const u8* sample, usize sample_size);
+    void Clear();
+
+    usize DictCapacity() const;
+    usize SampleCount() const;
+    usize SamplesSize() const;
+
+    // ZDICT_trainFromBuffer, fastCover with default parameters
+    ZstdResult Train(Vec<u8>& dict_bytes) const;
+
+    // ZDICT_optimizeTrainFromBuffer_fastCover, searches parameters for `compression_level`
+    // with `threads` threads (multi-threading requires zstd built with ZSTD_MULTITHREAD).
+    ZstdResult TrainOptimized(Vec<u8>& dict_bytes, int compression_level, u32 threads) const;
+
+private:
+    usize       dict_capacity_;
+    ByteBuffer  samples_;
+    Vec<size_t> sample_sizes_;
+};
@@ -1,4 +1,4 @@
-#include "zstd.h"
+#include "zstd-allocator-internal.h"
 #include "zstd-dict.h"
 
 
@@ -14,6 +14,27 @@ static void CloseDDict(ZSTD_DDict_s* ddict)
 }
 
 
+static ZSTD_CDict_s* CreateCDictByReference(const u8* dict_bytes, usize dict_size, int compression_level)
+{
+    // NOTE: failed mappings have no bytes
+    if (dict_bytes == nullptr) return nullptr;
+    return ZSTD_createCDict_byReference(dict_bytes, dict_size, compression_level);
+}
+
+
+static ZSTD_compressionParameters DictCParams(usize dict_size, int compression_level)
+{
+    return ZSTD_getCParams(compression_level, ZSTD_CONTENTSIZE_UNKNOWN, dict_size);
+}
+
+
+static ZSTD_DDict_s* CreateDDictByReference(const u8* dict_bytes, usize dict_size)
+{
+    if (dict_bytes == nullptr) return nullptr;
+    return ZSTD_createDDict_byReference(dict_bytes, dict_size);
+}
+
+
 //
 // ZstdCompressionDict
 //
@@ -21,10 +42,60 @@ static void CloseDDict(ZSTD_DDict_s* ddict)
 
 ZstdCompressionDict::ZstdCompressionDict(const Vec<u8>& dict_bytes, int compression_level)
     : Resource(ZSTD_createCDict(&dict_bytes[0], dict_bytes.size(), compression_level), CloseCDict)
+    , owner_()
+{
+}
+
+
+ZstdCompressionDict::ZstdCompressionDict(const Vec<u8>& dict_bytes, int compression_level, IZstdAllocator& allocator)
+    : Resource(ZSTD_createCDict_advanced(dict_bytes.data(), dict_bytes.size(),
+                                         ZSTD_dlm_byCopy, ZSTD_dct_auto,
+                                         DictCParams(dict_bytes.size(), compression_level),
+                                         ToCustomMem(&allocator)),
+               CloseCDict)
+    , owner_()
 {
 }
 
 
+ZstdCompressionDict::ZstdCompressionDict(const u8* dict_bytes, usize dict_size, int compression_level,
+                                         std::shared_ptr<const void> owner)
+    : Resource(CreateCDictByReference(dict_bytes, dict_size, compression_level), CloseCDict)
+    , owner_(std::move(owner))
+{
+}
+
+
+ZstdCompressionDict::ZstdCompressionDict(std::shared_ptr<const MappedFile> file, int compression_level)
+    : ZstdCompressionDict(file->data(), file->size(), compression_level, file)
+{
+}
+
+
+ZstdCompressionDict::ZstdCompressionDict(const u8* dict_bytes, usize dict_size, int compression_level, ZstdWorkspace workspace)
+    : Resource(const_cast<ZSTD_CDict_s*>(ZSTD_initStaticCDict(workspace.data, workspace.size,
+                                                              dict_bytes, dict_size,
+                                                              ZSTD_dlm_byRef, ZSTD_dct_auto,
+                                                              DictCParams(dict_size, compression_level))),
+               CloseStatic<ZSTD_CDict_s>)
+    , owner_()
+{
+}
+
+
+ZstdCompressionDict::~ZstdCompressionDict()
+{
+    // NOTE: free the dictionary before releasing bytes it refers to
+    Close();
+}
+
+
+usize ZstdCompressionDict::EstimateSize(usize dict_size, int compression_level)
+{
+    return ZSTD_estimateCDictSize_advanced(dict_size, DictCParams(dict_size, compression_level), ZSTD_dlm_byRef);
+}
+
+
 bool ZstdCompressionDict::fail() const
 {
     return get() == nullptr;
@@ -38,7 +109,54 @@ bool ZstdCompressionDict::fail() const
 
 ZstdDecompressionDict ::ZstdDecompressionDict(const Vec<u8>& dict_bytes)
     : Resource(ZSTD_createDDict(&dict_bytes[0], dict_bytes.size()), CloseDDict)
+    , owner_()
+{
+}
+
+
+ZstdDecompressionDict::ZstdDecompressionDict(const Vec<u8>& dict_bytes, IZstdAllocator& allocator)
+    : Resource(ZSTD_createDDict_advanced(dict_bytes.data(), dict_bytes.size(),
+                                         ZSTD_dlm_byCopy, ZSTD_dct_auto,
+                                         ToCustomMem(&allocator)),
+               CloseDDict)
+    , owner_()
+{
+}
+
+
+ZstdDecompressionDict::ZstdDecompressionDict(const u8* dict_bytes, usize dict_size,
+                                             std::shared_ptr<const void> owner)
+    : Resource(CreateDDictByReference(dict_bytes, dict_size), CloseDDict)
+    , owner_(std::move(owner))
+{
+}
+
+
+ZstdDecompressionDict::ZstdDecompressionDict(std::shared_ptr<const MappedFile> file)
+    : ZstdDecompressionDict(file->data(), file->size(), file)
+{
+}
+
+
+ZstdDecompressionDict::ZstdDecompressionDict(const u8* dict_bytes, usize dict_size, ZstdWorkspace workspace)
+    : Resource(const_cast<ZSTD_DDict_s*>(ZSTD_initStaticDDict(workspace.data, workspace.size,
+                                                              dict_bytes, dict_size,
+                                                              ZSTD_dlm_byRef, ZSTD_dct_auto)),
+               CloseStatic<ZSTD_DDict_s>)
+    , owner_()
+{
+}
+
+
+ZstdDecompressionDict::~ZstdDecompressionDict()
+{
+    Close();
+}
+
+
+usize ZstdDecompressionDict::EstimateSize(usize dict_size)
 {
+    return ZSTD_estimateDDictSize(dict_size, ZSTD_dlm_byRef);
 }
 
 
@@ -47,3 +165,45 @@ bool ZstdDecompressionDict::fail() const
     return get() == nullptr;
 }
 
+
+
+//
+// ZstdDecompressionDictSet
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdDecompressionDictSet::ZstdDecompressionDictSet()
+    : ddicts_()
+{
+}
+
+
+u32 ZstdDecompressionDictSet::Add(ZstdDecompressionDictHandle ddict)
+{
+    if (ddict == nullptr || ddict->fail()) return 0;
+
+    const auto dict_id = ZSTD_getDictID_fromDDict(ddict->get());
+    if (dict_id == 0) return 0;
+
+    const auto inserted = ddicts_.emplace(dict_id, std::move(ddict)).second;
+    return inserted ? dict_id : 0;
+}
+
+
+bool ZstdDecompressionDictSet::Remove(u32 dict_id)
+{
+    return ddicts_.erase(dict_id) > 0;
+}
+
+
+const ZstdDecompressionDict* ZstdDecompressionDictSet::Find(u32 dict_id) const
+{
+    const auto it = ddicts_.find(dict_id);
+    return it != ddicts_.end() ? it->second.get() : nullptr;
+}
+
+
+usize ZstdDecompressionDictSet::Size() const
+{
+    return ddicts_.size();
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <memory>
+#include <unordered_map>
+
 #include "common-types.h"
+#include "mapped-file.h"
 #include "raii-resource.h"
+#include "zstd-context.h"
 
 
 extern "C" {
@@ -10,12 +15,30 @@ struct ZSTD_DDict_s;    // orginal struct of ZSTD_DDict
 }
 
 
+class IZstdAllocator;
+
+
+// NOTE: constructors taking a pointer or a mapped file load the dictionary by reference,
+//       without copying it. the bytes must outlive the dictionary, `owner` (or the mapping)
+//       is kept alive until the dictionary is freed.
 class ZstdCompressionDict : public Resource<ZSTD_CDict_s>
 {
 public:
     ZstdCompressionDict(const Vec<u8>& dict_bytes, int compression_level);
+    ZstdCompressionDict(const Vec<u8>& dict_bytes, int compression_level, IZstdAllocator& allocator);
+    ZstdCompressionDict(const u8* dict_bytes, usize dict_size, int compression_level,
+                        std::shared_ptr<const void> owner = nullptr);
+    ZstdCompressionDict(std::shared_ptr<const MappedFile> file, int compression_level);
+    // NOTE: placed in `workspace`, by reference
+    ZstdCompressionDict(const u8* dict_bytes, usize dict_size, int compression_level, ZstdWorkspace workspace);
+    ~ZstdCompressionDict();
+
+    static usize EstimateSize(usize dict_size, int compression_level);
 
     bool fail() const;
+
+private:
+    std::shared_ptr<const void> owner_;
 };
 
 
@@ -23,7 +46,59 @@ class ZstdDecompressionDict : public Resource<ZSTD_DDict_s>
 {
 public:
     ZstdDecompressionDict(const Vec<u8>& dict_bytes);
+    ZstdDecompressionDict(const Vec<u8>& dict_bytes, IZstdAllocator& allocator);
+    ZstdDecompressionDict(const u8* dict_bytes, usize dict_size,
+                          std::shared_ptr<const void> owner = nullptr);
+    ZstdDecompressionDict(std::shared_ptr<const MappedFile> file);
+    // NOTE: placed in `workspace`, by reference
+    ZstdDecompressionDict(const u8* dict_bytes, usize dict_size, ZstdWorkspace workspace);
+    ~ZstdDecompressionDict();
+
+    static usize EstimateSize(usize dict_size);
 
     bool fail() const;
+
+private:
+    std::shared_ptr<const void> owner_;
+};
+
+
+// NOTE: handles share ownership of a dictionary, see ZstdDictRegistry.
+using ZstdCompressionDictHandle = std::shared_ptr<const ZstdCompressionDict>;
+using ZstdDecompressionDictHandle = std::shared_ptr<const ZstdDecompressionDict>;
+
+
+// Decompression dictionaries keyed by dictID, to select the dictionary of each frame
+// from its header when decoding frames of many producers.
+class ZstdDecompressionDictSet
+{
+public:
+    ZstdDecompressionDictSet();
+
+    // NOTE: returns dictID of `ddict`, or 0 when it failed to load, has no id
+    //       (raw content dictionary) or the id is already in the set.
+    u32 Add(ZstdDecompressionDictHandle ddict);
+    bool Remove(u32 dict_id);
+
+    // NOTE: returns nullptr if not found.
+    const ZstdDecompressionDict* Find(u32 dict_id) const;
+    usize Size() const;
+
+    template <typename Visit>
+    void ForEach(Visit visit) const;
+
+private:
+    std::unordered_map<u32, ZstdDecompressionDictHandle> ddicts_;
 };
 
+
+// ==== IMPLEMENTATIONS =======================================================
+//
+
+template <typename Visit>
+void ZstdDecompressionDictSet::ForEach(Visit visit) const
+{
+    for (const auto& ddict : ddicts_) {
+        visit(*ddict.second);
+    }
+}
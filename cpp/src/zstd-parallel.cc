@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "zstd.h"
+#include "zstd_errors.h"
+#include "zstd-codec.h"
+#include "zstd-parallel.h"
+
+
+// Fixed set of threads running a batch of indexed tasks at a time.
+class WorkerPool
+{
+public:
+    using Task = std::function<void(usize task_index, usize worker_index)>;
+
+    explicit WorkerPool(usize workers)
+        : mutex_()
+        , start_cond_()
+        , done_cond_()
+        , task_()
+        , task_count_(0)
+        , next_task_(0)
+        , running_(0)
+        , generation_(0)
+        , stopping_(false)
+        , threads_()
+    {
+        // NOTE: caller thread works as worker 0
+        for (usize i = 1; i < workers; ++i) {
+            threads_.emplace_back([this, i]() { WorkerLoop(i); });
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+
+        start_cond_.notify_all();
+        for (auto& thread : threads_) thread.join();
+    }
+
+    // NOTE: blocks until all tasks are done, must not be called concurrently
+    void Run(usize task_count, const Task& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = &task;
+            task_count_ = task_count;
+            next_task_ = 0;
+            running_ = threads_.size();
+            ++generation_;
+        }
+
+        start_cond_.notify_all();
+        RunTasks(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cond_.wait(lock, [this]() { return running_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+    void WorkerLoop(usize worker_index)
+    {
+        usize generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_cond_.wait(lock, [&]() { return stopping_ || generation_ != generation; });
+                if (stopping_) return;
+
+                generation = generation_;
+            }
+
+            RunTasks(worker_index);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--running_ == 0) done_cond_.notify_one();
+        }
+    }
+
+    void RunTasks(usize worker_index)
+    {
+        for (;;) {
+            const auto task_index = next_task_.fetch_add(1);
+            if (task_index >= task_count_) return;
+
+            (*task_)(task_index, worker_index);
+        }
+    }
+
+    std::mutex              mutex_;
+    std::condition_variable start_cond_;
+    std::condition_variable done_cond_;
+
+    const Task*             task_;
+    usize                   task_count_;
+    std::atomic<usize>      next_task_;
+    usize                   running_;
+    usize                   generation_;
+    bool                    stopping_;
+
+    Vec<std::thread>        threads_;
+};
+
+
+//
+// ZstdParallelCodec
+//
+////////////////////////////////////////////////////////////////////////////////
+
+const usize ZstdParallelCodec::kDefaultChunkSize;
+
+
+ZstdParallelCodec::ZstdParallelCodec(usize workers, usize chunk_size)
+    : chunk_size_(std::max<usize>(chunk_size, 1))
+    , pool_(new WorkerPool(std::max<usize>(workers, 1)))
+    , codecs_()
+{
+    for (usize i = 0; i < std::max<usize>(workers, 1); ++i) {
+        codecs_.emplace_back(new ZstdCodec());
+    }
+}
+
+
+ZstdParallelCodec::~ZstdParallelCodec()
+{
+}
+
+
+usize ZstdParallelCodec::Workers() const
+{
+    return codecs_.size();
+}
+
+
+usize ZstdParallelCodec::ChunkSize() const
+{
+    return chunk_size_;
+}
+
+
+ZstdResult ZstdParallelCodec::CompressBound(usize src_size) const
+{
+    const auto chunk_count = std::max<usize>((src_size + chunk_size_ - 1) / chunk_size_, 1);
+    const auto full_chunk_bound = ZSTD_compressBound(chunk_size_);
+    const auto last_chunk_bound = ZSTD_compressBound(src_size - (chunk_count - 1) * chunk_size_);
+
+    return ZstdResult::Ok(static_cast<u64>(chunk_count - 1) * full_chunk_bound + last_chunk_bound);
+}
+
+
+ZstdResult ZstdParallelCodec::Compress(ByteBuffer& dest, const u8* src, usize src_size, int compression_level)
+{
+    const auto bound = CompressBound(src_size);
+    if (bound.size > static_cast<u64>(SIZE_MAX)) return ZstdResult::Error(ZstdError::SizeTooLarge);
+
+    // NOTE: empty input still produces one (empty) frame
+    const auto chunk_count = std::max<usize>((src_size + chunk_size_ - 1) / chunk_size_, 1);
+    const auto slot_size = static_cast<usize>(ZSTD_compressBound(chunk_size_));
+
+    // compress each chunk into its own slot, then pack frames
+    dest.resize(static_cast<usize>(bound.size));
+    Vec<ZstdResult> results(chunk_count, ZstdResult::Error(ZstdError::Zstd));
+
+    pool_->Run(chunk_count, [&](usize chunk_index, usize worker_index) {
+        const auto src_offset = chunk_index * chunk_size_;
+        const auto src_chunk_size = std::min(chunk_size_, src_size - std::min(src_offset, src_size));
+        const auto dest_offset = chunk_index * slot_size;
+
+        results[chunk_index] = codecs_[worker_index]->Compress(dest.data() + dest_offset,
+                                                               std::min(slot_size, dest.size() - dest_offset),
+                                                               src + src_offset, src_chunk_size,
+                                                               compression_level);
+    });
+
+    usize dest_size = 0;
+    for (usize i = 0; i < chunk_count; ++i) {
+        if (!results[i].ok()) {
+            dest.clear();
+            return results[i];
+        }
+
+        const auto frame_size = static_cast<usize>(results[i].size);
+        std::memmove(dest.data() + dest_size, dest.data() + i * slot_size, frame_size);
+        dest_size += frame_size;
+    }
+
+    dest.resize(dest_size);
+    return ZstdResult::Ok(dest_size);
+}
+
+
+ZstdResult ZstdParallelCodec::Decompress(ByteBuffer& dest, const u8* src, usize src_size)
+{
+    struct Frame
+    {
+        usize   src_offset;
+        usize   src_size;
+        usize   dest_offset;
+        usize   dest_size;
+    };
+
+    // locate frames and their place in output
+    Vec<Frame> frames;
+    usize src_offset = 0;
+    u64 dest_size = 0;
+    while (src_offset < src_size) {
+        const auto frame_size = ZSTD_findFrameCompressedSize(src + src_offset, src_size - src_offset);
+        if (ZSTD_isError(frame_size)) return ZstdResult::Error(ZstdError::Zstd, ZSTD_getErrorCode(frame_size));
+
+        const auto content_size = ZSTD_getFrameContentSize(src + src_offset, frame_size);
+        if (content_size == ZSTD_CONTENTSIZE_UNKNOWN) return ZstdResult::Error(ZstdError::ContentSizeUnknown);
+        if (content_size == ZSTD_CONTENTSIZE_ERROR) return ZstdResult::Error(ZstdError::Zstd, ZSTD_error_prefix_unknown);
+
+        frames.push_back(Frame { src_offset, frame_size, static_cast<usize>(dest_size), static_cast<usize>(content_size) });
+        src_offset += frame_size;
+        dest_size += content_size;
+    }
+
+    if (dest_size > static_cast<u64>(SIZE_MAX)) return ZstdResult::Error(ZstdError::SizeTooLarge);
+
+    dest.resize(static_cast<usize>(dest_size));
+    Vec<ZstdResult> results(frames.size(), ZstdResult::Error(ZstdError::Zstd));
+
+    pool_->Run(frames.size(), [&](usize frame_index, usize worker_index) {
+        const auto& frame = frames[frame_index];
+        results[frame_index] = codecs_[worker_index]->Decompress(dest.data() + frame.dest_offset, frame.dest_size,
+                                                                 src + frame.src_offset, frame.src_size);
+    });
+
+    for (usize i = 0; i < frames.size(); ++i) {
+        if (!results[i].ok() || results[i].size != frames[i].dest_size) {
+            dest.clear();
+            return results[i].ok() ? ZstdResult::Error(ZstdError::Zstd, ZSTD_error_corruption_detected) : results[i];
+        }
+    }
+
+    return ZstdResult::Ok(dest_size);
+}
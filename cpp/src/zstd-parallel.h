@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+
+#include "common-types.h"
+#include "zstd-result.h"
+
+
+class ZstdCodec;
+class WorkerPool;
+
+
+// Compresses input as independent frames of `chunk_size` bytes on worker threads,
+// so that the result can also be decompressed in parallel.
+//
+// NOTE: output is a plain concatenation of zstd frames, which any zstd decoder
+//       can decompress. parallel decompression requires frame content sizes,
+//       which ZstdParallelCodec::Compress always writes.
+//       Compress and Decompress share the worker threads and their contexts, so they
+//       must not be called concurrently on one instance.
+class ZstdParallelCodec
+{
+public:
+    static const usize kDefaultChunkSize = 4 * 1024 * 1024;
+
+    explicit ZstdParallelCodec(usize workers, usize chunk_size = kDefaultChunkSize);
+    ~ZstdParallelCodec();
+
+    ZstdParallelCodec(const ZstdParallelCodec&) = delete;
+    ZstdParallelCodec& operator=(const ZstdParallelCodec&) = delete;
+
+    usize Workers() const;
+    usize ChunkSize() const;
+
+    ZstdResult CompressBound(usize src_size) const;
+    ZstdResult Compress(ByteBuffer& dest, const u8* src, usize src_size, int compression_level);
+    ZstdResult Decompress(ByteBuffer& dest, const u8* src, usize src_size);
+
+private:
+    const usize                 chunk_size_;
+    std::unique_ptr<WorkerPool> pool_;
+    Vec<std::unique_ptr<ZstdCodec>> codecs_;   // one codec (and its contexts) per worker
+};
@@ -0,0 +1,151 @@
+#include <climits>
+
+#include "zstd-params.h"
+
+
+static void CloseCCtxParams(ZSTD_CCtx_params* params)
+{
+    ZSTD_freeCCtxParams(params);
+}
+
+
+static bool InBounds(ZSTD_cParameter parameter, int value)
+{
+    const auto bounds = ZSTD_cParam_getBounds(parameter);
+    if (ZSTD_isError(bounds.error)) return false;
+
+    return bounds.lowerBound <= value && value <= bounds.upperBound;
+}
+
+
+//
+// ZstdCompressionParams
+//
+////////////////////////////////////////////////////////////////////////////////
+
+const int ZstdCompressionParams::kLongRangeWindowLog;
+
+
+ZstdCompressionParams::ZstdCompressionParams()
+    : Resource(ZSTD_createCCtxParams(), CloseCCtxParams)
+{
+}
+
+
+ZstdCompressionParams::ZstdCompressionParams(int compression_level)
+    : ZstdCompressionParams()
+{
+    if (!fail() && !SetCompressionLevel(compression_level)) Close();
+}
+
+
+bool ZstdCompressionParams::fail() const
+{
+    return get() == nullptr;
+}
+
+
+bool ZstdCompressionParams::Set(ZSTD_cParameter parameter, int value)
+{
+    if (fail() || !InBounds(parameter, value)) return false;
+
+    const auto rc = ZSTD_CCtxParams_setParameter(get(), parameter, value);
+    return !ZSTD_isError(rc);
+}
+
+
+bool ZstdCompressionParams::Get(ZSTD_cParameter parameter, int& value) const
+{
+    if (fail()) return false;
+
+    const auto rc = ZSTD_CCtxParams_getParameter(get(), parameter, &value);
+    return !ZSTD_isError(rc);
+}
+
+
+bool ZstdCompressionParams::SetCompressionLevel(int compression_level)
+{
+    return Set(ZSTD_c_compressionLevel, compression_level);
+}
+
+
+bool ZstdCompressionParams::SetWindowLog(int window_log)
+{
+    return Set(ZSTD_c_windowLog, window_log);
+}
+
+
+bool ZstdCompressionParams::SetStrategy(ZSTD_strategy strategy)
+{
+    return Set(ZSTD_c_strategy, strategy);
+}
+
+
+bool ZstdCompressionParams::SetLongDistanceMatching(bool enable)
+{
+    // NOTE: explicit switch, zstd enables it by itself (ZSTD_ps_auto) for btopt+ with large windows
+    return Set(ZSTD_c_enableLongDistanceMatching, enable ? ZSTD_ps_enable : ZSTD_ps_disable);
+}
+
+
+bool ZstdCompressionParams::LongDistanceMatching() const
+{
+    int value = 0;
+    return Get(ZSTD_c_enableLongDistanceMatching, value) && value == ZSTD_ps_enable;
+}
+
+
+bool ZstdCompressionParams::SetChecksumFlag(bool enable)
+{
+    return Set(ZSTD_c_checksumFlag, enable ? 1 : 0);
+}
+
+
+bool ZstdCompressionParams::SetContentSizeFlag(bool enable)
+{
+    return Set(ZSTD_c_contentSizeFlag, enable ? 1 : 0);
+}
+
+
+bool ZstdCompressionParams::SetTargetCBlockSize(usize target_size)
+{
+    if (target_size > static_cast<usize>(INT_MAX)) return false;
+    return Set(ZSTD_c_targetCBlockSize, static_cast<int>(target_size));
+}
+
+
+bool ZstdCompressionParams::SetWorkers(int workers)
+{
+    return Set(ZSTD_c_nbWorkers, workers);
+}
+
+
+bool ZstdCompressionParams::SetLongRange(int window_log)
+{
+    if (!InBounds(ZSTD_c_windowLog, window_log)) return false;
+    return SetWindowLog(window_log) && SetLongDistanceMatching(true);
+}
+
+
+bool ZstdCompressionParams::SetPatchFrom(u64 reference_size, u64 src_size)
+{
+    int compression_level = 0;
+    if (!Get(ZSTD_c_compressionLevel, compression_level)) return false;
+
+    const auto window_size = reference_size + src_size;
+    const auto bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+    auto window_log = bounds.lowerBound;
+    while (window_log < bounds.upperBound && (1ull << window_log) < window_size) ++window_log;
+    if ((1ull << window_log) < window_size) return false;
+
+    const auto level_params = ZSTD_getCParams(compression_level, src_size, reference_size);
+    const auto long_range = window_log > static_cast<int>(level_params.windowLog);
+
+    return SetWindowLog(window_log) && (!long_range || SetLongDistanceMatching(true));
+}
+
+
+size_t ZstdCompressionParams::ApplyTo(ZSTD_CCtx* cctx) const
+{
+    return ZSTD_CCtx_setParametersUsingCCtxParams(cctx, get());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common-types.h"
+#include "raii-resource.h"
+#include "zstd.h"
+
+
+extern "C" {
+struct ZSTD_CCtx_params_s;  // original struct of ZSTD_CCtx_params, declared only with ZSTD_STATIC_LINKING_ONLY
+}
+
+
+// Compression parameters, built once and applied to ZstdCodec and ZstdCompressStream.
+//
+// NOTE: setters validate values with ZSTD_cParam_getBounds, and keep current
+//       value and return false if a value is out of bounds.
+class ZstdCompressionParams : public Resource<ZSTD_CCtx_params_s>
+{
+public:
+    ZstdCompressionParams();
+    explicit ZstdCompressionParams(int compression_level);
+
+    // NOTE: owns ZSTD_CCtx_params, copies would free it twice
+    ZstdCompressionParams(const ZstdCompressionParams&) = delete;
+    ZstdCompressionParams& operator=(const ZstdCompressionParams&) = delete;
+
+    bool fail() const;
+
+    bool Set(ZSTD_cParameter parameter, int value);
+    bool Get(ZSTD_cParameter parameter, int& value) const;
+
+    bool SetCompressionLevel(int compression_level);
+    bool SetWindowLog(int window_log);
+    bool SetStrategy(ZSTD_strategy strategy);
+    bool SetLongDistanceMatching(bool enable);
+    // NOTE: true only when enabled explicitly, not when left to zstd (auto)
+    bool LongDistanceMatching() const;
+    bool SetChecksumFlag(bool enable);
+    bool SetContentSizeFlag(bool enable);
+    bool SetTargetCBlockSize(usize target_size);
+    bool SetWorkers(int workers);
+
+    // long-range mode, long distance matching with a window of 2^window_log bytes.
+    // NOTE: stream decoders need ZstdDecompressStream::SetWindowLogMax for windows over 2^27.
+    static const int kLongRangeWindowLog = 27;
+    bool SetLongRange(int window_log = kLongRangeWindowLog);
+
+    // patch-from mode, for compression against a reference (prefix) of `reference_size` bytes.
+    // sizes the window to cover the reference and the input, and enables long distance matching
+    // when the window exceeds the one of the compression level (like `zstd --patch-from`).
+    bool SetPatchFrom(u64 reference_size, u64 src_size);
+
+    // NOTE: requires !fail(), zstd copies params so an instance can be applied repeatedly.
+    size_t ApplyTo(ZSTD_CCtx* cctx) const;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common-types.h"
+
+
+// NOTE: values are kept negative, the emscripten binding reports them as-is.
+enum class ZstdError : int
+{
+    None = 0,
+    Zstd = -1,                  // zstd reported an error, see ZstdResult::zstd_code
+    SizeTooLarge = -2,
+    AllocateCCtx = -3,
+    AllocateDCtx = -4,
+    LoadCDict = -5,
+    LoadDDict = -6,
+    ContentSizeUnknown = -7,
+    SrcSizeTooSmall = -8,       // more input is required, see ZstdResult::size
+    InvalidParams = -9,
+};
+
+
+// Result of codec operations, `size` is valid only if ok(),
+// or it is the required input size for ZstdError::SrcSizeTooSmall.
+struct ZstdResult
+{
+    u64         size;
+    ZstdError   error;
+    int         zstd_code;      // ZSTD_ErrorCode, when error is ZstdError::Zstd
+
+    static ZstdResult Ok(u64 size) { return ZstdResult { size, ZstdError::None, 0 }; }
+    static ZstdResult Error(ZstdError error, int zstd_code = 0) { return ZstdResult { 0, error, zstd_code }; }
+    static ZstdResult SrcSizeTooSmall(u64 required_size) { return ZstdResult { required_size, ZstdError::SrcSizeTooSmall, 0 }; }
+
+    bool ok() const { return error == ZstdError::None; }
+    const char* ErrorName() const;
+};
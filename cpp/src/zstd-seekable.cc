@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cstring>
+
+#include "zstd-seekable.h"
+
+
+const usize ZstdSeekableWriter::kDefaultMaxFrameSize;
+const usize ZstdSeekableWriter::kMaxFrameSizeLimit;
+const usize ZstdSeekableReader::kDefaultCacheFrames;
+
+
+static const u32 kSkippableMagicNumber = 0x184D2A5E;
+static const u32 kSeekableMagicNumber = 0x8F92EAB1;
+
+static const usize kSkippableHeaderSize = 8;
+static const usize kSeekTableFooterSize = 9;
+
+static const u8 kChecksumFlag = 0x80;
+static const u8 kReservedBits = 0x7C;
+
+
+static void AppendU32(ByteBuffer& dest, u32 value)
+{
+    const u8 bytes[] = {
+        static_cast<u8>(value),
+        static_cast<u8>(value >> 8),
+        static_cast<u8>(value >> 16),
+        static_cast<u8>(value >> 24),
+    };
+    dest.append(bytes, sizeof(bytes));
+}
+
+
+static u32 ReadU32(const u8* src)
+{
+    return static_cast<u32>(src[0])
+        | (static_cast<u32>(src[1]) << 8)
+        | (static_cast<u32>(src[2]) << 16)
+        | (static_cast<u32>(src[3]) << 24);
+}
+
+
+//
+// ZstdSeekableWriter
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdSeekableWriter::ZstdSeekableWriter(usize max_frame_size)
+    : max_frame_size_(std::min(std::max<usize>(max_frame_size, 1), kMaxFrameSizeLimit))
+    , begun_(false)
+    , stream_()
+    , frame_open_(false)
+    , frame_()
+    , entries_()
+{
+}
+
+
+ZstdSeekableWriter::~ZstdSeekableWriter()
+{
+}
+
+
+bool ZstdSeekableWriter::Begin(int compression_level)
+{
+    if (begun_) return true;
+
+    if (!stream_.Begin(compression_level)) return false;
+
+    begun_ = true;
+    frame_open_ = false;
+    entries_.clear();
+
+    return true;
+}
+
+
+bool ZstdSeekableWriter::Transform(const u8* chunk, usize chunk_size, const SeekableSink& sink)
+{
+    if (!begun_) return false;
+
+    const auto counting_sink = [this, &sink](const u8* bytes, usize size) {
+        frame_.compressed_size += static_cast<u32>(size);
+        sink(bytes, size);
+    };
+
+    usize chunk_offset = 0;
+    while (chunk_offset < chunk_size) {
+        if (!frame_open_) BeginFrame();
+
+        // split chunk at frame boundary
+        const auto frame_remains = max_frame_size_ - frame_.decompressed_size;
+        const auto write_size = std::min(frame_remains, chunk_size - chunk_offset);
+        if (!stream_.Transform(chunk + chunk_offset, write_size, counting_sink)) return false;
+
+        frame_.decompressed_size += static_cast<u32>(write_size);
+        chunk_offset += write_size;
+
+        if (frame_.decompressed_size == max_frame_size_ && !EndFrame(sink)) return false;
+    }
+
+    return true;
+}
+
+
+bool ZstdSeekableWriter::EndFrame(const SeekableSink& sink)
+{
+    if (!frame_open_) return true;
+
+    const auto counting_sink = [this, &sink](const u8* bytes, usize size) {
+        frame_.compressed_size += static_cast<u32>(size);
+        sink(bytes, size);
+    };
+
+    if (!stream_.NextFrame(counting_sink)) return false;
+
+    entries_.push_back(frame_);
+    frame_open_ = false;
+    return true;
+}
+
+
+bool ZstdSeekableWriter::End(const SeekableSink& sink)
+{
+    if (!begun_) return false;
+    if (!EndFrame(sink)) return false;
+
+    // NOTE: all frames are ended, nothing is dropped
+    stream_.Reset();
+
+    WriteSeekTable(sink);
+    begun_ = false;
+    return true;
+}
+
+
+void ZstdSeekableWriter::BeginFrame()
+{
+    // NOTE: the stream starts the next frame on the next input after NextFrame
+    frame_ = FrameEntry { 0, 0 };
+    frame_open_ = true;
+}
+
+
+void ZstdSeekableWriter::WriteSeekTable(const SeekableSink& sink)
+{
+    const auto table_size = entries_.size() * 8 + kSeekTableFooterSize;
+
+    ByteBuffer table;
+    table.reserve(kSkippableHeaderSize + table_size);
+
+    AppendU32(table, kSkippableMagicNumber);
+    AppendU32(table, static_cast<u32>(table_size));
+
+    for (const auto& entry : entries_) {
+        AppendU32(table, entry.compressed_size);
+        AppendU32(table, entry.decompressed_size);
+    }
+
+    const u8 descriptor = 0;    // no checksums
+    AppendU32(table, static_cast<u32>(entries_.size()));
+    table.append(&descriptor, 1);
+    AppendU32(table, kSeekableMagicNumber);
+
+    sink(table.data(), table.size());
+}
+
+
+//
+// ZstdSeekableReader
+//
+////////////////////////////////////////////////////////////////////////////////
+
+ZstdSeekableReader::ZstdSeekableReader(const u8* src, usize src_size, usize cache_frames)
+    : ZstdSeekableReader([src, src_size](u64 offset, u8* dest, usize size) {
+                             if (offset > src_size || size > src_size - offset) return false;
+
+                             std::memcpy(dest, src + offset, size);
+                             return true;
+                         },
+                         src_size, cache_frames)
+{
+}
+
+
+ZstdSeekableReader::ZstdSeekableReader(ReadSource source, u64 source_size, usize cache_frames)
+    : source_(source)
+    , valid_(false)
+    , entries_()
+    , codec_()
+    , compressed_bytes_()
+    , cache_frames_(std::max<usize>(cache_frames, 1))
+    , cache_()
+    , cache_index_()
+{
+    valid_ = LoadSeekTable(source_size);
+}
+
+
+ZstdSeekableReader::~ZstdSeekableReader()
+{
+}
+
+
+bool ZstdSeekableReader::fail() const
+{
+    return !valid_;
+}
+
+
+usize ZstdSeekableReader::FrameCount() const
+{
+    return entries_.size();
+}
+
+
+u64 ZstdSeekableReader::ContentSize() const
+{
+    if (entries_.empty()) return 0;
+
+    const auto& last = entries_.back();
+    return last.decompressed_offset + last.decompressed_size;
+}
+
+
+bool ZstdSeekableReader::ReadAt(ByteBuffer& dest, u64 offset, usize length)
+{
+    dest.clear();
+    if (!valid_) return false;
+
+    const auto content_size = ContentSize();
+    if (offset > content_size) return false;
+
+    length = static_cast<usize>(std::min<u64>(length, content_size - offset));
+    dest.resize(length);
+
+    // first frame covering `offset`
+    auto it = std::upper_bound(std::begin(entries_), std::end(entries_), offset,
+                               [](u64 value, const FrameEntry& entry) { return value < entry.decompressed_offset; });
+    auto frame_index = static_cast<usize>(std::distance(std::begin(entries_), it)) - 1;
+
+    usize dest_offset = 0;
+    while (dest_offset < length) {
+        // skip empty frames
+        const auto& entry = entries_[frame_index];
+        if (entry.decompressed_size == 0) {
+            ++frame_index;
+            continue;
+        }
+
+        const auto frame = DecodeFrame(frame_index);
+        if (frame == nullptr) {
+            dest.clear();
+            return false;
+        }
+
+        const auto frame_offset = static_cast<usize>(offset + dest_offset - entry.decompressed_offset);
+        const auto copy_size = std::min(length - dest_offset, frame->size() - frame_offset);
+        std::memcpy(dest.data() + dest_offset, frame->data() + frame_offset, copy_size);
+
+        dest_offset += copy_size;
+        ++frame_index;
+    }
+
+    return true;
+}
+
+
+bool ZstdSeekableReader::LoadSeekTable(u64 source_size)
+{
+    if (source_size < kSkippableHeaderSize + kSeekTableFooterSize) return false;
+
+    // footer
+    u8 footer[kSeekTableFooterSize];
+    if (!source_(source_size - kSeekTableFooterSize, footer, sizeof(footer))) return false;
+
+    const auto frame_count = ReadU32(&footer[0]);
+    const auto descriptor = footer[4];
+    if (ReadU32(&footer[5]) != kSeekableMagicNumber) return false;
+    if ((descriptor & kReservedBits) != 0) return false;
+
+    const usize entry_size = (descriptor & kChecksumFlag) ? 12 : 8;
+    const auto table_size = static_cast<u64>(frame_count) * entry_size + kSeekTableFooterSize;
+    if (kSkippableHeaderSize + table_size > source_size) return false;
+
+    // whole skippable frame
+    ByteBuffer table(static_cast<usize>(kSkippableHeaderSize + table_size));
+    const auto table_offset = source_size - table.size();
+    if (!source_(table_offset, table.data(), table.size())) return false;
+
+    if (ReadU32(&table[0]) != kSkippableMagicNumber) return false;
+    if (ReadU32(&table[4]) != table_size) return false;
+
+    entries_.reserve(frame_count);
+
+    u64 compressed_offset = 0;
+    u64 decompressed_offset = 0;
+    for (usize i = 0; i < frame_count; ++i) {
+        const auto entry = &table[kSkippableHeaderSize + i * entry_size];
+        const auto compressed_size = ReadU32(entry);
+        const auto decompressed_size = ReadU32(entry + 4);
+
+        entries_.push_back(FrameEntry { compressed_offset, decompressed_offset, compressed_size, decompressed_size });
+        compressed_offset += compressed_size;
+        decompressed_offset += decompressed_size;
+    }
+
+    // frames must fill the data in front of seek table
+    return compressed_offset == table_offset;
+}
+
+
+const ByteBuffer* ZstdSeekableReader::DecodeFrame(usize frame_index)
+{
+    const auto cached = cache_index_.find(frame_index);
+    if (cached != std::end(cache_index_)) {
+        cache_.splice(std::begin(cache_), cache_, cached->second);
+        return &cached->second->second;
+    }
+
+    const auto& entry = entries_[frame_index];
+    compressed_bytes_.resize(entry.compressed_size);
+    if (!source_(entry.compressed_offset, compressed_bytes_.data(), compressed_bytes_.size())) return nullptr;
+
+    // NOTE: the seek table is not trusted for allocation, check it against the frame
+    const auto content_size = ZSTD_getFrameContentSize(compressed_bytes_.data(), compressed_bytes_.size());
+    if (content_size == ZSTD_CONTENTSIZE_ERROR) return nullptr;
+    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        const auto bound = ZSTD_decompressBound(compressed_bytes_.data(), compressed_bytes_.size());
+        if (bound == ZSTD_CONTENTSIZE_ERROR || bound < entry.decompressed_size) return nullptr;
+    }
+    else if (content_size != entry.decompressed_size) {
+        return nullptr;
+    }
+
+    ByteBuffer frame(entry.decompressed_size);
+    const auto result = codec_.Decompress(frame.data(), frame.size(), compressed_bytes_.data(), compressed_bytes_.size());
+    if (!result.ok() || result.size != entry.decompressed_size) return nullptr;
+
+    // evict least recently used frame
+    if (cache_.size() >= cache_frames_) {
+        cache_index_.erase(cache_.back().first);
+        cache_.pop_back();
+    }
+
+    cache_.emplace_front(frame_index, std::move(frame));
+    cache_index_[frame_index] = std::begin(cache_);
+    return &cache_.front().second;
+}
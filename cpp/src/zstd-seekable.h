@@ -0,0 +1,100 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "common-types.h"
+#include "zstd-codec.h"
+#include "zstd-stream.h"
+
+
+// Seekable format, compatible with zstd's contrib/seekable_format:
+// independent zstd frames followed by a seek table stored in a skippable frame.
+//
+// NOTE: the writer doesn't store per-frame checksums in the seek table,
+//       the reader accepts seek tables with or without them.
+
+using SeekableSink = std::function<void(const u8*, usize)>;
+
+
+// NOTE: frames of a write share one stream, ZstdCompressStream::NextFrame ends each of them
+class ZstdSeekableWriter
+{
+public:
+    static const usize kDefaultMaxFrameSize = 1024 * 1024;
+    static const usize kMaxFrameSizeLimit = 1024 * 1024 * 1024;
+
+    explicit ZstdSeekableWriter(usize max_frame_size = kDefaultMaxFrameSize);
+    ~ZstdSeekableWriter();
+
+    bool Begin(int compression_level);
+    bool Transform(const u8* chunk, usize chunk_size, const SeekableSink& sink);
+    bool EndFrame(const SeekableSink& sink);    // start next frame explicitly
+    bool End(const SeekableSink& sink);         // close the last frame, then write seek table
+
+private:
+    struct FrameEntry
+    {
+        u32     compressed_size;
+        u32     decompressed_size;
+    };
+
+    void BeginFrame();
+    void WriteSeekTable(const SeekableSink& sink);
+
+    const usize         max_frame_size_;
+    bool                begun_;
+    ZstdCompressStream  stream_;
+    bool                frame_open_;
+    FrameEntry          frame_;
+    Vec<FrameEntry>     entries_;
+};
+
+
+class ZstdSeekableReader
+{
+public:
+    // NOTE: reads `size` bytes at `offset` of the seekable data into `dest`
+    using ReadSource = std::function<bool(u64 offset, u8* dest, usize size)>;
+
+    static const usize kDefaultCacheFrames = 8;
+
+    ZstdSeekableReader(const u8* src, usize src_size, usize cache_frames = kDefaultCacheFrames);
+    ZstdSeekableReader(ReadSource source, u64 source_size, usize cache_frames = kDefaultCacheFrames);
+    ~ZstdSeekableReader();
+
+    bool fail() const;
+
+    usize FrameCount() const;
+    u64 ContentSize() const;
+
+    // NOTE: reads are clipped at the end of content, `dest` holds the bytes read
+    bool ReadAt(ByteBuffer& dest, u64 offset, usize length);
+
+private:
+    struct FrameEntry
+    {
+        u64     compressed_offset;
+        u64     decompressed_offset;
+        u32     compressed_size;
+        u32     decompressed_size;
+    };
+
+    using CachedFrame = std::pair<usize, ByteBuffer>;
+
+    bool LoadSeekTable(u64 source_size);
+    const ByteBuffer* DecodeFrame(usize frame_index);
+
+    ReadSource      source_;
+    bool            valid_;
+    Vec<FrameEntry> entries_;
+    ZstdCodec       codec_;
+    ByteBuffer      compressed_bytes_;
+
+    // LRU of decoded frames, most recently used first
+    const usize                                                 cache_frames_;
+    std::list<CachedFrame>                                      cache_;
+    std::unordered_map<usize, std::list<CachedFrame>::iterator> cache_index_;
+};
@@ -1,19 +1,92 @@
 #include <algorithm>
+#include <chrono>
+#include <initializer_list>
+#include <utility>
+
+#include "zstd-allocator-internal.h"
 #include "zstd-dict.h"
+#include "zstd-params.h"
 #include "zstd-stream.h"
 
+
+// NOTE: adapts StreamCallback to sink api. zstd writes into `callback_bytes` while it spans the
+//       whole `buffer_size`, otherwise into the stream's buffer, and the output is copied.
+//       a Vec<u8> cannot grow back without zero-filling, so it does only when filling the rest
+//       is cheaper than copying an output of the same size.
+static auto CallbackSink(Vec<u8>& callback_bytes, usize buffer_size, const StreamCallback& callback)
+{
+    return [&callback_bytes, buffer_size, &callback](const u8* bytes, usize size) {
+        if (bytes == callback_bytes.data()) {
+            callback_bytes.resize(size);
+        }
+        else {
+            callback_bytes.assign(bytes, bytes + size);
+        }
+
+        callback(callback_bytes);
+        if (size >= buffer_size / 2) callback_bytes.resize(buffer_size);
+    };
+}
+
+
+// NOTE: adapts StreamBufferCallback to sink api, the callback receives the stream's output buffer.
+static auto CallbackSink(ByteBuffer& dest_bytes, const StreamBufferCallback& callback)
+{
+    return [&dest_bytes, &callback](const u8*, usize size) {
+        dest_bytes.resize(size);
+        callback(dest_bytes);
+    };
+}
+
+
+// NOTE: returns the first error, or 0 when all parameters are accepted
+static size_t SetParameters(ZSTD_CCtx* cctx, std::initializer_list<std::pair<ZSTD_cParameter, int>> parameters)
+{
+    for (const auto& parameter : parameters) {
+        const auto rc = ZSTD_CCtx_setParameter(cctx, parameter.first, parameter.second);
+        if (ZSTD_isError(rc)) return rc;
+    }
+
+    return 0;
+}
+
+
+static ZSTD_EndDirective ToEndDirective(StreamDirective directive)
+{
+    switch (directive) {
+    case StreamDirective::Flush:    return ZSTD_e_flush;
+    case StreamDirective::End:      return ZSTD_e_end;
+    default:                        return ZSTD_e_continue;
+    }
+}
+
+
 //
 // ZstdCompressStream
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+const usize ZstdCompressStream::kAdaptivePeriod;
+
 
 ZstdCompressStream::ZstdCompressStream()
-    : stream_(nullptr, ZSTD_freeCStream)
+    : allocator_(nullptr)
+    , stream_(nullptr, ZSTD_freeCStream)
     , next_read_size_()
     , src_bytes_()
     , dest_bytes_()
+    , callback_bytes_()
+    , use_callback_bytes_(false)
+    , adaptive_()
+    , auto_flush_()
+{
+}
+
+
+ZstdCompressStream::ZstdCompressStream(IZstdAllocator& allocator)
+    : ZstdCompressStream()
 {
+    allocator_ = &allocator;
 }
 
 
@@ -25,7 +98,7 @@ ZstdCompressStream::~ZstdCompressStream()
 bool ZstdCompressStream::Begin(int compression_level)
 {
     return Begin([compression_level](ZSTD_CStream* cstream) {
-        return ZSTD_initCStream(cstream, compression_level);
+        return ZSTD_CCtx_setParameter(cstream, ZSTD_c_compressionLevel, compression_level);
     });
 }
 
@@ -33,67 +106,179 @@ bool ZstdCompressStream::Begin(int compression_level)
 bool ZstdCompressStream::Begin(const ZstdCompressionDict& cdict)
 {
     return Begin([&cdict](ZSTD_CStream* cstream) {
-        return ZSTD_initCStream_usingCDict(cstream, cdict.get());
+        return ZSTD_CCtx_refCDict(cstream, cdict.get());
     });
 }
 
 
-bool ZstdCompressStream::Transform(const Vec<u8>& chunk, StreamCallback callback)
+bool ZstdCompressStream::Begin(int compression_level, int workers, usize job_size, int overlap_log)
 {
-    if (!HasStream()) return false;
+    // NOTE: check before narrowing, large sizes would wrap around as int
+    const auto bounds = ZSTD_cParam_getBounds(ZSTD_c_jobSize);
+    if (ZSTD_isError(bounds.error) || static_cast<usize>(bounds.upperBound) < job_size) return false;
+
+    return Begin([=](ZSTD_CStream* cstream) {
+        return SetParameters(cstream, {
+            { ZSTD_c_compressionLevel, compression_level },
+            { ZSTD_c_nbWorkers, workers },
+            { ZSTD_c_jobSize, static_cast<int>(job_size) },
+            { ZSTD_c_overlapLog, overlap_log },
+        });
+    });
+}
 
-    auto chunk_offset = 0u;
-    while (chunk_offset < chunk.size()) {
-        const auto src_available = src_bytes_.capacity() - src_bytes_.size();
-        const auto chunk_remains = chunk.size() - chunk_offset;
-        const auto copy_size = std::min(src_available, chunk_remains);
 
-        const auto copy_begin = std::begin(chunk) + chunk_offset;
-        const auto copy_end = copy_begin + copy_size;
+bool ZstdCompressStream::Begin(const ZstdCompressionParams& params)
+{
+    if (params.fail()) return false;
 
-        chunk_offset += copy_size;
+    return Begin([&params](ZSTD_CStream* cstream) {
+        return params.ApplyTo(cstream);
+    });
+}
 
-        // append src bytes
-        std::copy(copy_begin, copy_end, std::back_inserter(src_bytes_));
 
-        // compress if enough bytes ready
-        if (src_bytes_.size() >= next_read_size_ || src_available == 0u) {
-            const auto success = Compress(callback);
-            if (!success) return false;
-        }
-    }
+bool ZstdCompressStream::BeginUsingPrefix(const u8* prefix, usize prefix_size, int compression_level, u64 src_size_hint)
+{
+    ZstdCompressionParams params(compression_level);
+    if (params.fail() || !params.SetPatchFrom(prefix_size, src_size_hint > 0u ? src_size_hint : prefix_size)) return false;
+
+    return Begin([&](ZSTD_CStream* cstream) {
+        const auto rc = params.ApplyTo(cstream);
+        if (ZSTD_isError(rc)) return rc;
 
+        return ZSTD_CCtx_refPrefix(cstream, prefix, prefix_size);
+    });
+}
+
+
+bool ZstdCompressStream::BeginAdaptive(int compression_level, int min_level, int max_level)
+{
+    if (HasStream()) return true;
+    if (min_level > max_level) return false;
+
+    const auto level = std::min(std::max(compression_level, min_level), max_level);
+    const auto success = Begin([level](ZSTD_CStream* cstream) {
+        return ZSTD_CCtx_setParameter(cstream, ZSTD_c_compressionLevel, level);
+    });
+    if (!success) return false;
+
+    adaptive_.enabled = true;
+    adaptive_.min_level = min_level;
+    adaptive_.max_level = max_level;
+    adaptive_.stats.level = level;
     return true;
 }
 
 
+StreamAdaptiveStats ZstdCompressStream::AdaptiveStats() const
+{
+    return adaptive_.stats;
+}
+
+
+void ZstdCompressStream::SetAutoFlush(usize max_pending_bytes, u64 max_pending_us)
+{
+    auto_flush_.max_pending_bytes = max_pending_bytes;
+    auto_flush_.max_pending_us = max_pending_us;
+}
+
+
+bool ZstdCompressStream::Transform(const Vec<u8>& chunk, StreamCallback callback)
+{
+    return Transform(chunk.data(), chunk.size(), callback);
+}
+
+
+bool ZstdCompressStream::Transform(const u8* chunk, usize chunk_size, StreamCallback callback)
+{
+    return UsingCallbackBytes([&]() {
+        return Transform(chunk, chunk_size, CallbackSink(callback_bytes_, dest_bytes_.capacity(), callback));
+    });
+}
+
+
 bool ZstdCompressStream::Flush(StreamCallback callback)
 {
-    return Compress(callback);
+    return UsingCallbackBytes([&]() {
+        return Flush(CallbackSink(callback_bytes_, dest_bytes_.capacity(), callback));
+    });
 }
 
 
 bool ZstdCompressStream::End(StreamCallback callback)
 {
-    if (!HasStream()) return true;
+    return UsingCallbackBytes([&]() {
+        return End(CallbackSink(callback_bytes_, dest_bytes_.capacity(), callback));
+    });
+}
 
-    auto success = true;
-    if (!src_bytes_.empty()) {
-        success = Compress(callback);
-    }
 
-    if (success) {
-        dest_bytes_.resize(dest_bytes_.capacity());
-        ZSTD_outBuffer output { &dest_bytes_[0], dest_bytes_.size(), 0 };
-        const auto remaining = ZSTD_endStream(stream_.get(), &output);
-        if (remaining > 0u) return false;
+bool ZstdCompressStream::Transform(const Vec<u8>& chunk, StreamBufferCallback callback)
+{
+    return Transform(chunk.data(), chunk.size(), callback);
+}
 
-        dest_bytes_.resize(output.pos);
-        callback(dest_bytes_);
-    }
 
+bool ZstdCompressStream::Transform(const u8* chunk, usize chunk_size, StreamBufferCallback callback)
+{
+    return Transform(chunk, chunk_size, CallbackSink(dest_bytes_, callback));
+}
+
+
+bool ZstdCompressStream::Flush(StreamBufferCallback callback)
+{
+    return Flush(CallbackSink(dest_bytes_, callback));
+}
+
+
+bool ZstdCompressStream::End(StreamBufferCallback callback)
+{
+    return End(CallbackSink(dest_bytes_, callback));
+}
+
+
+bool ZstdCompressStream::Poll(StreamCallback callback)
+{
+    return UsingCallbackBytes([&]() {
+        return Poll(CallbackSink(callback_bytes_, dest_bytes_.capacity(), callback));
+    });
+}
+
+
+bool ZstdCompressStream::Poll(StreamBufferCallback callback)
+{
+    return Poll(CallbackSink(dest_bytes_, callback));
+}
+
+
+void ZstdCompressStream::Reset()
+{
     stream_.reset();
-    return success;
+    src_bytes_.clear();
+}
+
+
+StreamProgress ZstdCompressStream::Compress(StreamInBuffer& input, StreamOutBuffer& output, StreamDirective directive)
+{
+    StreamProgress progress { false, 0, 0, 0 };
+    if (!HasStream() || !src_bytes_.empty()) return progress;
+
+    const auto input_pos = input.pos;
+    const auto output_pos = output.pos;
+    const auto rc = ZSTD_compressStream2(stream_.get(), &output, &input, ToEndDirective(directive));
+
+    progress.success = !ZSTD_isError(rc);
+    progress.consumed = input.pos - input_pos;
+    progress.produced = output.pos - output_pos;
+    progress.remaining = progress.success ? rc : 0u;
+
+    // NOTE: frame completed, same as End()
+    if (progress.success && directive == StreamDirective::End && rc == 0u) {
+        stream_.reset();
+    }
+
+    return progress;
 }
 
 
@@ -103,11 +288,33 @@ bool ZstdCompressStream::HasStream() const
 }
 
 
+bool ZstdCompressStream::UsingCallbackBytes(const std::function<bool()>& function)
+{
+    use_callback_bytes_ = true;
+    const auto success = function();
+    use_callback_bytes_ = false;
+    return success;
+}
+
+
+ZSTD_outBuffer ZstdCompressStream::OutputBuffer()
+{
+    if (use_callback_bytes_ && callback_bytes_.size() == dest_bytes_.capacity()) {
+        return ZSTD_outBuffer { callback_bytes_.data(), callback_bytes_.size(), 0 };
+    }
+
+    return ZSTD_outBuffer { dest_bytes_.data(), dest_bytes_.capacity(), 0 };
+}
+
+
 bool ZstdCompressStream::Begin(CStreamInitializer initializer)
 {
     if (HasStream()) return true;
 
-    CStreamPtr stream(ZSTD_createCStream(), ZSTD_freeCStream);
+    adaptive_ = AdaptiveState();
+    auto_flush_.pending_bytes = 0;
+
+    CStreamPtr stream(ZSTD_createCStream_advanced(ToCustomMem(allocator_)), ZSTD_freeCStream);
     if (stream == nullptr) return false;
 
     const auto init_rc = initializer(stream.get());
@@ -115,30 +322,55 @@ bool ZstdCompressStream::Begin(CStreamInitializer initializer)
 
     stream_ = std::move(stream);
     src_bytes_.reserve(ZSTD_CStreamInSize());
-    dest_bytes_.resize(ZSTD_CStreamOutSize());  // resize
+    dest_bytes_.reserve(ZSTD_CStreamOutSize());
     next_read_size_ = src_bytes_.capacity();
 
     return true;
 }
 
 
-bool ZstdCompressStream::Compress(const StreamCallback& callback)
+u64 ZstdCompressStream::MonotonicNs()
 {
-    if (src_bytes_.empty()) return true;
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
 
-    ZSTD_inBuffer input { &src_bytes_[0], src_bytes_.size(), 0 };
-    while (input.pos < input.size) {
-        dest_bytes_.resize(dest_bytes_.capacity());
-        ZSTD_outBuffer output { &dest_bytes_[0], dest_bytes_.size(), 0};
-        next_read_size_ = ZSTD_compressStream(stream_.get(), &output, &input);
-        if (ZSTD_isError(next_read_size_)) return false;
 
-        dest_bytes_.resize(output.pos);
-        callback(dest_bytes_);
-    }
+void ZstdCompressStream::OnPending(usize size)
+{
+    if (auto_flush_.max_pending_bytes == 0u && auto_flush_.max_pending_us == 0u) return;
+    if (size == 0u) return;
 
-    src_bytes_.clear();
-    return true;
+    if (auto_flush_.pending_bytes == 0u) auto_flush_.pending_since_ns = MonotonicNs();
+    auto_flush_.pending_bytes += size;
+}
+
+
+bool ZstdCompressStream::AutoFlushDue() const
+{
+    if (auto_flush_.pending_bytes == 0u) return false;
+    if (auto_flush_.max_pending_bytes > 0u && auto_flush_.pending_bytes >= auto_flush_.max_pending_bytes) return true;
+    if (auto_flush_.max_pending_us == 0u) return false;
+
+    return MonotonicNs() - auto_flush_.pending_since_ns >= auto_flush_.max_pending_us * 1000u;
+}
+
+
+int ZstdCompressStream::NextAdaptiveLevel()
+{
+    const auto compress_ns = adaptive_.period_compress_ns;
+    const auto sink_ns = adaptive_.period_sink_ns;
+
+    adaptive_.period_consumed = 0;
+    adaptive_.period_compress_ns = 0;
+    adaptive_.period_sink_ns = 0;
+
+    // NOTE: change level only when one side is clearly slower, to avoid oscillation
+    const auto level = adaptive_.stats.level;
+    if (sink_ns > 2 * compress_ns) return std::min(level + 1, adaptive_.max_level);
+    if (compress_ns > 2 * sink_ns) return std::max(level - 1, adaptive_.min_level);
+
+    return level;
 }
 
 
@@ -148,14 +380,25 @@ bool ZstdCompressStream::Compress(const StreamCallback& callback)
 ///////////////////////////////////////////////////////////////////////////////
 
 ZstdDecompressStream::ZstdDecompressStream()
-    : stream_(nullptr, ZSTD_freeDStream)
+    : allocator_(nullptr)
+    , stream_(nullptr, ZSTD_freeDStream)
     , next_read_size_()
+    , window_log_max_(0)
     , src_bytes_()
     , dest_bytes_()
+    , callback_bytes_()
+    , use_callback_bytes_(false)
 {
 }
 
 
+ZstdDecompressStream::ZstdDecompressStream(IZstdAllocator& allocator)
+    : ZstdDecompressStream()
+{
+    allocator_ = &allocator;
+}
+
+
 ZstdDecompressStream::~ZstdDecompressStream()
 {
 }
@@ -177,52 +420,116 @@ bool ZstdDecompressStream::Begin(const ZstdDecompressionDict& ddict)
 }
 
 
-bool ZstdDecompressStream::Transform(const Vec<u8>& chunk, StreamCallback callback)
+bool ZstdDecompressStream::Begin(const ZstdDecompressionDictSet& ddicts)
 {
-    if (!HasStream()) return false;
+    return Begin([&ddicts](ZSTD_DStream* dstream) {
+        const auto rc = ZSTD_initDStream(dstream);
+        if (ZSTD_isError(rc)) return rc;
+
+        const auto multiple_rc = ZSTD_DCtx_setParameter(dstream, ZSTD_d_refMultipleDDicts, ZSTD_rmd_refMultipleDDicts);
+        if (ZSTD_isError(multiple_rc)) return multiple_rc;
+
+        size_t ref_rc = 0;
+        ddicts.ForEach([&](const ZstdDecompressionDict& ddict) {
+            if (!ZSTD_isError(ref_rc)) ref_rc = ZSTD_DCtx_refDDict(dstream, ddict.get());
+        });
+        return ZSTD_isError(ref_rc) ? ref_rc : rc;
+    });
+}
 
-    auto chunk_offset = 0u;
-    while (chunk_offset < chunk.size()) {
-        const auto src_available = src_bytes_.capacity() - src_bytes_.size();
-        const auto chunk_remains = chunk.size() - chunk_offset;
-        const auto copy_size = std::min(src_available, chunk_remains);
 
-        const auto copy_begin = std::begin(chunk) + chunk_offset;
-        const auto copy_end = copy_begin + copy_size;
+bool ZstdDecompressStream::BeginUsingPrefix(const u8* prefix, usize prefix_size)
+{
+    return Begin([=](ZSTD_DStream* dstream) {
+        const auto rc = ZSTD_initDStream(dstream);
+        if (ZSTD_isError(rc)) return rc;
 
-        chunk_offset += copy_size;
+        const auto prefix_rc = ZSTD_DCtx_refPrefix(dstream, prefix, prefix_size);
+        return ZSTD_isError(prefix_rc) ? prefix_rc : rc;
+    });
+}
 
-        // append src bytes
-        std::copy(copy_begin, copy_end, std::back_inserter(src_bytes_));
 
-        // compress if enough bytes ready
-        if (src_bytes_.size() >= next_read_size_ || src_available == 0u) {
-            const auto success = Decompress(callback);
-            if (!success) return false;
-        }
-    }
+bool ZstdDecompressStream::SetWindowLogMax(int window_log_max)
+{
+    const auto bounds = ZSTD_dParam_getBounds(ZSTD_d_windowLogMax);
+    if (ZSTD_isError(bounds.error)) return false;
+    if (window_log_max != 0 && (window_log_max < bounds.lowerBound || bounds.upperBound < window_log_max)) return false;
 
+    window_log_max_ = window_log_max;
     return true;
 }
 
 
+bool ZstdDecompressStream::Transform(const Vec<u8>& chunk, StreamCallback callback)
+{
+    return Transform(chunk.data(), chunk.size(), callback);
+}
+
+
+bool ZstdDecompressStream::Transform(const u8* chunk, usize chunk_size, StreamCallback callback)
+{
+    return UsingCallbackBytes([&]() {
+        return Transform(chunk, chunk_size, CallbackSink(callback_bytes_, dest_bytes_.capacity(), callback));
+    });
+}
+
+
 bool ZstdDecompressStream::Flush(StreamCallback callback)
 {
-    return Decompress(callback);
+    return UsingCallbackBytes([&]() {
+        return Flush(CallbackSink(callback_bytes_, dest_bytes_.capacity(), callback));
+    });
 }
 
 
 bool ZstdDecompressStream::End(StreamCallback callback)
 {
-    if (!HasStream()) return true;
+    return UsingCallbackBytes([&]() {
+        return End(CallbackSink(callback_bytes_, dest_bytes_.capacity(), callback));
+    });
+}
 
-    auto success = true;
-    if (!src_bytes_.empty()) {
-        success = Decompress(callback);
-    }
 
-    stream_.reset();
-    return success;
+bool ZstdDecompressStream::Transform(const Vec<u8>& chunk, StreamBufferCallback callback)
+{
+    return Transform(chunk.data(), chunk.size(), callback);
+}
+
+
+bool ZstdDecompressStream::Transform(const u8* chunk, usize chunk_size, StreamBufferCallback callback)
+{
+    return Transform(chunk, chunk_size, CallbackSink(dest_bytes_, callback));
+}
+
+
+bool ZstdDecompressStream::Flush(StreamBufferCallback callback)
+{
+    return Flush(CallbackSink(dest_bytes_, callback));
+}
+
+
+bool ZstdDecompressStream::End(StreamBufferCallback callback)
+{
+    return End(CallbackSink(dest_bytes_, callback));
+}
+
+
+StreamProgress ZstdDecompressStream::Decompress(StreamInBuffer& input, StreamOutBuffer& output)
+{
+    StreamProgress progress { false, 0, 0, 0 };
+    if (!HasStream() || !src_bytes_.empty()) return progress;
+
+    const auto input_pos = input.pos;
+    const auto output_pos = output.pos;
+    const auto rc = ZSTD_decompressStream(stream_.get(), &output, &input);
+
+    progress.success = !ZSTD_isError(rc);
+    progress.consumed = input.pos - input_pos;
+    progress.produced = output.pos - output_pos;
+    progress.remaining = progress.success ? rc : 0u;
+
+    return progress;
 }
 
 
@@ -232,40 +539,44 @@ bool ZstdDecompressStream::HasStream() const
 }
 
 
+bool ZstdDecompressStream::UsingCallbackBytes(const std::function<bool()>& function)
+{
+    use_callback_bytes_ = true;
+    const auto success = function();
+    use_callback_bytes_ = false;
+    return success;
+}
+
+
+ZSTD_outBuffer ZstdDecompressStream::OutputBuffer()
+{
+    if (use_callback_bytes_ && callback_bytes_.size() == dest_bytes_.capacity()) {
+        return ZSTD_outBuffer { callback_bytes_.data(), callback_bytes_.size(), 0 };
+    }
+
+    return ZSTD_outBuffer { dest_bytes_.data(), dest_bytes_.capacity(), 0 };
+}
+
+
 bool ZstdDecompressStream::Begin(DStreamInitializer initializer)
 {
     if (HasStream()) return true;
 
-    DStreamPtr stream(ZSTD_createDStream(), ZSTD_freeDStream);
+    DStreamPtr stream(ZSTD_createDStream_advanced(ToCustomMem(allocator_)), ZSTD_freeDStream);
     if (stream == nullptr) return false;
 
     const auto init_rc = initializer(stream.get());
     if (ZSTD_isError(init_rc)) return false;
 
+    if (window_log_max_ != 0) {
+        const auto rc = ZSTD_DCtx_setParameter(stream.get(), ZSTD_d_windowLogMax, window_log_max_);
+        if (ZSTD_isError(rc)) return false;
+    }
+
     stream_ = std::move(stream);
     src_bytes_.reserve(ZSTD_DStreamInSize());
-    dest_bytes_.resize(ZSTD_DStreamOutSize());  // resize
+    dest_bytes_.reserve(ZSTD_DStreamOutSize());
     next_read_size_ = init_rc;
 
     return true;
 }
-
-
-bool ZstdDecompressStream::Decompress(const StreamCallback& callback)
-{
-    if (src_bytes_.empty()) return true;
-
-    ZSTD_inBuffer input { &src_bytes_[0], src_bytes_.size(), 0 };
-    while (input.pos < input.size) {
-        dest_bytes_.resize(dest_bytes_.capacity());
-        ZSTD_outBuffer output { &dest_bytes_[0], dest_bytes_.size(), 0};
-        next_read_size_ = ZSTD_decompressStream(stream_.get(), &output, &input);
-        if (ZSTD_isError(next_read_size_)) return false;
-
-        dest_bytes_.resize(output.pos);
-        callback(dest_bytes_);
-    }
-
-    src_bytes_.clear();
-    return true;
-}
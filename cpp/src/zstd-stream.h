@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 #include "common-types.h"
 #include "zstd.h"
@@ -8,35 +12,187 @@
 
 using StreamCallback = std::function<void(const Vec<u8>&)>;
 
+// NOTE: receives the stream's output buffer itself, StreamCallback receives a copy of it.
+using StreamBufferCallback = std::function<void(const ByteBuffer&)>;
+
+
+// NOTE: a sink is any callable with `void(const u8* bytes, usize size)` signature,
+//       it is invoked only with non-empty output and may be inlined by the compiler.
+template <typename Sink>
+using EnableIfStreamSink = decltype(std::declval<Sink&>()(std::declval<const u8*>(), std::declval<usize>()), void());
+
+
+// pull-style api types, caller owns both buffers and zstd advances `pos` of them.
+using StreamInBuffer = ZSTD_inBuffer;
+using StreamOutBuffer = ZSTD_outBuffer;
+
+
+enum class StreamDirective
+{
+    Continue,   // compress as much as possible, may keep data buffered
+    Flush,      // flush all data compressed so far (ends current block)
+    End,        // flush all data and finish the frame
+};
+
+
+struct StreamProgress
+{
+    bool    success;
+    usize   consumed;   // bytes read from input by the call
+    usize   produced;   // bytes written into output by the call
+    usize   remaining;  // compress: bytes left to flush (flush/end), decompress: next input size hint
+};
+
+
+// adaptive mode telemetry
+struct StreamAdaptiveStats
+{
+    int     level;          // current compression level
+    u64     level_changes;
+    u64     consumed;       // bytes read from input
+    u64     produced;       // bytes passed to the sink
+    u64     compress_ns;    // time spent in zstd
+    u64     sink_ns;        // time spent in the sink, i.e. draining output
+};
+
 
 class ZstdCompressionDict;
 class ZstdDecompressionDict;
+class ZstdDecompressionDictSet;
+class ZstdCompressionParams;
+class IZstdAllocator;
 
 
 class ZstdCompressStream
 {
 public:
     ZstdCompressStream();
+    // NOTE: zstd's stream state is allocated from `allocator`, staging buffers are not
+    explicit ZstdCompressStream(IZstdAllocator& allocator);
     ~ZstdCompressStream();
 
     bool Begin(int compression_level);
     bool Begin(const ZstdCompressionDict& cdict);
     bool Transform(const Vec<u8>& chunk, StreamCallback callback);
+    bool Transform(const u8* chunk, usize chunk_size, StreamCallback callback);
     bool Flush(StreamCallback callback);
     bool End(StreamCallback callback);
 
+    bool Transform(const Vec<u8>& chunk, StreamBufferCallback callback);
+    bool Transform(const u8* chunk, usize chunk_size, StreamBufferCallback callback);
+    bool Flush(StreamBufferCallback callback);
+    bool End(StreamBufferCallback callback);
+
+    // multi-threaded compression, requires zstd built with ZSTD_MULTITHREAD.
+    // `job_size` and `overlap_log` use zstd's defaults when 0.
+    // returns false when `job_size` exceeds zstd's limit.
+    bool Begin(int compression_level, int workers, usize job_size = 0, int overlap_log = 0);
+
+    // NOTE: `params` are copied, so they can be reused or released after Begin.
+    bool Begin(const ZstdCompressionParams& params);
+
+    // delta compression against a reference (prefix) kept alive by the caller until End.
+    // NOTE: window is sized for `src_size_hint` bytes of input (prefix size if 0),
+    //       decoders need SetWindowLogMax for windows over 2^27.
+    bool BeginUsingPrefix(const u8* prefix, usize prefix_size, int compression_level, u64 src_size_hint = 0);
+
+    // adaptive mode, like `zstd --adapt`. the level is raised when the sink drains output
+    // slower than zstd compresses, and lowered when zstd is slower than the sink.
+    // NOTE: a new level applies from the next frame, the current frame is ended and a new frame
+    //       (concatenated) starts. single-threaded only, with workers zstd just hands input off
+    //       to jobs and the timings don't tell which side is slower.
+    //       the pull-style api does not adapt.
+    static const usize kAdaptivePeriod = 1024 * 1024;
+    bool BeginAdaptive(int compression_level, int min_level, int max_level);
+    StreamAdaptiveStats AdaptiveStats() const;
+
+    // auto flush, Transform flushes output once `max_pending_bytes` of input, or input older than
+    // `max_pending_us` microseconds is pending (0 disables a limit). for low latency combine with
+    // ZstdCompressionParams::SetTargetCBlockSize, which bounds the size of compressed blocks.
+    // NOTE: the time limit is checked only on calls, call Poll while input is idle.
+    void SetAutoFlush(usize max_pending_bytes, u64 max_pending_us);
+    bool Poll(StreamCallback callback);
+    bool Poll(StreamBufferCallback callback);
+
+    // sink api
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool Transform(const u8* chunk, usize chunk_size, Sink&& sink);
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool Flush(Sink&& sink);
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool End(Sink&& sink);
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool Poll(Sink&& sink);
+
+    // frame boundary, ends the current frame but keeps the context and its parameters.
+    // the next Transform starts a new frame.
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool NextFrame(Sink&& sink);
+
+    // drops the stream without finishing the current frame, Begin starts a new one.
+    void Reset();
+
+    // pull-style api, must not be mixed with Transform in the same frame.
+    // the stream is closed when a frame has been finished by StreamDirective::End.
+    StreamProgress Compress(StreamInBuffer& input, StreamOutBuffer& output, StreamDirective directive);
+
 private:
     using CStreamPtr = std::unique_ptr<ZSTD_CStream, decltype(&ZSTD_freeCStream)>;
     using CStreamInitializer = std::function<size_t(ZSTD_CStream*)>;
 
     bool HasStream() const;
     bool Begin(CStreamInitializer initializer);
-    bool Compress(const StreamCallback& callback);
 
-    CStreamPtr  stream_;
-    size_t      next_read_size_;
-    Vec<u8>     src_bytes_;
-    Vec<u8>     dest_bytes_;
+    // NOTE: StreamCallback api lets zstd write into callback_bytes_ when it spans the whole buffer
+    bool UsingCallbackBytes(const std::function<bool()>& function);
+    ZSTD_outBuffer OutputBuffer();
+
+    template <typename Sink>
+    bool CompressStaged(Sink& sink);
+    template <typename Sink>
+    bool CompressInput(ZSTD_inBuffer& input, Sink& sink);
+    template <typename Sink>
+    bool FlushBlock(Sink& sink);
+    template <typename Sink>
+    bool EndFrame(Sink& sink);
+    template <typename Sink>
+    void EmitOutput(const ZSTD_outBuffer& output, Sink& sink);
+
+    struct AdaptiveState
+    {
+        bool                enabled;
+        int                 min_level;
+        int                 max_level;
+        u64                 period_consumed;
+        u64                 period_compress_ns;
+        u64                 period_sink_ns;
+        StreamAdaptiveStats stats;
+    };
+
+    struct AutoFlushState
+    {
+        usize   max_pending_bytes;
+        u64     max_pending_us;
+        usize   pending_bytes;
+        u64     pending_since_ns;
+    };
+
+    static u64 MonotonicNs();
+    int NextAdaptiveLevel();
+    template <typename Sink>
+    bool AdaptLevel(Sink& sink);
+    void OnPending(usize size);
+    bool AutoFlushDue() const;
+
+    IZstdAllocator* allocator_;
+    CStreamPtr      stream_;
+    size_t          next_read_size_;
+    ByteBuffer      src_bytes_;
+    ByteBuffer      dest_bytes_;
+    Vec<u8>         callback_bytes_;
+    bool            use_callback_bytes_;
+    AdaptiveState   adaptive_;
+    AutoFlushState  auto_flush_;
 };
 
 
@@ -44,25 +200,373 @@ class ZstdDecompressStream
 {
 public:
     ZstdDecompressStream();
+    explicit ZstdDecompressStream(IZstdAllocator& allocator);
     ~ZstdDecompressStream();
 
     bool Begin();
     bool Begin(const ZstdDecompressionDict& ddict);
+
+    // NOTE: selects the dictionary of each frame by its dictID (hashed lookup in zstd).
+    //       dictionaries are referenced, `ddicts` must be alive and unchanged until End.
+    //       referencing costs O(ddicts.Size()) per Begin, reuse a stream for many frames.
+    bool Begin(const ZstdDecompressionDictSet& ddicts);
+
+    // NOTE: reference must be the same as the encoder's, and alive until End.
+    bool BeginUsingPrefix(const u8* prefix, usize prefix_size);
+
+    // NOTE: frames using windows larger than 2^window_log_max are rejected (zstd's default is 27),
+    //       long-range frames need a larger limit. applied from the next Begin, 0 restores default.
+    bool SetWindowLogMax(int window_log_max);
     bool Transform(const Vec<u8>& chunk, StreamCallback callback);
+    bool Transform(const u8* chunk, usize chunk_size, StreamCallback callback);
     bool Flush(StreamCallback callback);
     bool End(StreamCallback callback);
 
+    bool Transform(const Vec<u8>& chunk, StreamBufferCallback callback);
+    bool Transform(const u8* chunk, usize chunk_size, StreamBufferCallback callback);
+    bool Flush(StreamBufferCallback callback);
+    bool End(StreamBufferCallback callback);
+
+    // sink api
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool Transform(const u8* chunk, usize chunk_size, Sink&& sink);
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool Flush(Sink&& sink);
+    template <typename Sink, typename = EnableIfStreamSink<Sink>>
+    bool End(Sink&& sink);
+
+    // pull-style api, must not be mixed with Transform in the same stream.
+    StreamProgress Decompress(StreamInBuffer& input, StreamOutBuffer& output);
+
 private:
     using DStreamPtr = std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)>;
     using DStreamInitializer = std::function<size_t(ZSTD_DStream*)>;
 
     bool HasStream() const;
     bool Begin(DStreamInitializer initializer);
-    bool Decompress(const StreamCallback& callback);
 
+    // NOTE: StreamCallback api lets zstd write into callback_bytes_ when it spans the whole buffer
+    bool UsingCallbackBytes(const std::function<bool()>& function);
+    ZSTD_outBuffer OutputBuffer();
+
+    template <typename Sink>
+    bool DecompressStaged(Sink& sink);
+    template <typename Sink>
+    bool DecompressInput(ZSTD_inBuffer& input, Sink& sink);
+    template <typename Sink>
+    void EmitOutput(const ZSTD_outBuffer& output, Sink& sink);
+
+    IZstdAllocator* allocator_;
     DStreamPtr  stream_;
     size_t      next_read_size_;
-    Vec<u8>     src_bytes_;
-    Vec<u8>     dest_bytes_;
+    int         window_log_max_;
+    ByteBuffer  src_bytes_;
+    ByteBuffer  dest_bytes_;
+    Vec<u8>     callback_bytes_;
+    bool        use_callback_bytes_;
 };
 
+
+// ==== IMPLEMENTATIONS =======================================================
+//
+
+//
+// ZstdCompressStream
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename Sink, typename>
+bool ZstdCompressStream::Transform(const u8* chunk, usize chunk_size, Sink&& sink)
+{
+    if (!HasStream()) return false;
+    OnPending(chunk_size);
+
+    usize chunk_offset = 0;
+    while (chunk_offset < chunk_size) {
+        const auto chunk_remains = chunk_size - chunk_offset;
+
+        // use caller's bytes directly, if no bytes staged and enough bytes available
+        if (src_bytes_.empty() && chunk_remains >= next_read_size_) {
+            ZSTD_inBuffer input { chunk + chunk_offset, chunk_remains, 0 };
+            if (!CompressInput(input, sink)) return false;
+            break;
+        }
+
+        const auto src_available = src_bytes_.capacity() - src_bytes_.size();
+        const auto copy_size = std::min(src_available, chunk_remains);
+
+        // append src bytes
+        src_bytes_.append(chunk + chunk_offset, copy_size);
+        chunk_offset += copy_size;
+
+        // compress if enough bytes ready
+        if (src_bytes_.size() >= next_read_size_ || src_available == 0u) {
+            const auto success = CompressStaged(sink);
+            if (!success) return false;
+        }
+    }
+
+    return AutoFlushDue() ? Flush(sink) : true;
+}
+
+
+template <typename Sink, typename>
+bool ZstdCompressStream::Flush(Sink&& sink)
+{
+    if (!HasStream()) return true;
+
+    auto_flush_.pending_bytes = 0;
+    return CompressStaged(sink) && FlushBlock(sink);
+}
+
+
+template <typename Sink, typename>
+bool ZstdCompressStream::End(Sink&& sink)
+{
+    if (!HasStream()) return true;
+
+    auto success = true;
+    if (!src_bytes_.empty()) {
+        success = CompressStaged(sink);
+    }
+
+    success = success && EndFrame(sink);
+
+    stream_.reset();
+    return success;
+}
+
+
+template <typename Sink, typename>
+bool ZstdCompressStream::NextFrame(Sink&& sink)
+{
+    if (!HasStream()) return false;
+
+    auto_flush_.pending_bytes = 0;
+    return CompressStaged(sink) && EndFrame(sink);
+}
+
+
+template <typename Sink, typename>
+bool ZstdCompressStream::Poll(Sink&& sink)
+{
+    if (!HasStream()) return false;
+    return AutoFlushDue() ? Flush(sink) : true;
+}
+
+
+template <typename Sink>
+bool ZstdCompressStream::CompressStaged(Sink& sink)
+{
+    if (src_bytes_.empty()) return true;
+
+    ZSTD_inBuffer input { src_bytes_.data(), src_bytes_.size(), 0 };
+    const auto success = CompressInput(input, sink);
+
+    src_bytes_.clear();
+    return success;
+}
+
+
+template <typename Sink>
+bool ZstdCompressStream::CompressInput(ZSTD_inBuffer& input, Sink& sink)
+{
+    while (input.pos < input.size) {
+        const auto input_pos = input.pos;
+        const auto start = adaptive_.enabled ? MonotonicNs() : 0u;
+
+        // NOTE: same as ZSTD_compressStream2(ZSTD_e_continue), but returns next input size hint
+        auto output = OutputBuffer();
+        next_read_size_ = ZSTD_compressStream(stream_.get(), &output, &input);
+        if (ZSTD_isError(next_read_size_)) return false;
+
+        if (adaptive_.enabled) {
+            const auto elapsed = MonotonicNs() - start;
+            adaptive_.period_compress_ns += elapsed;
+            adaptive_.stats.compress_ns += elapsed;
+            adaptive_.period_consumed += input.pos - input_pos;
+            adaptive_.stats.consumed += input.pos - input_pos;
+        }
+
+        EmitOutput(output, sink);
+
+        if (adaptive_.enabled && adaptive_.period_consumed >= kAdaptivePeriod) {
+            if (!AdaptLevel(sink)) return false;
+        }
+    }
+
+    return true;
+}
+
+
+template <typename Sink>
+bool ZstdCompressStream::FlushBlock(Sink& sink)
+{
+    // NOTE: ZSTD_e_flush returns remaining bytes to flush, call until all bytes flushed
+    auto remaining = static_cast<size_t>(1);
+    while (remaining > 0u) {
+        ZSTD_inBuffer input { nullptr, 0, 0 };
+        auto output = OutputBuffer();
+        remaining = ZSTD_compressStream2(stream_.get(), &output, &input, ZSTD_e_flush);
+        if (ZSTD_isError(remaining)) return false;
+
+        EmitOutput(output, sink);
+    }
+
+    return true;
+}
+
+
+template <typename Sink>
+bool ZstdCompressStream::EndFrame(Sink& sink)
+{
+    // NOTE: ZSTD_e_end returns remaining bytes to flush, call until all bytes flushed
+    auto remaining = static_cast<size_t>(1);
+    while (remaining > 0u) {
+        ZSTD_inBuffer input { nullptr, 0, 0 };
+        auto output = OutputBuffer();
+        remaining = ZSTD_compressStream2(stream_.get(), &output, &input, ZSTD_e_end);
+        if (ZSTD_isError(remaining)) return false;
+
+        EmitOutput(output, sink);
+    }
+
+    return true;
+}
+
+
+template <typename Sink>
+void ZstdCompressStream::EmitOutput(const ZSTD_outBuffer& output, Sink& sink)
+{
+    if (output.pos == 0u) return;
+
+    if (!adaptive_.enabled) {
+        sink(static_cast<const u8*>(output.dst), output.pos);
+        return;
+    }
+
+    const auto start = MonotonicNs();
+    sink(static_cast<const u8*>(output.dst), output.pos);
+
+    const auto elapsed = MonotonicNs() - start;
+    adaptive_.period_sink_ns += elapsed;
+    adaptive_.stats.sink_ns += elapsed;
+    adaptive_.stats.produced += output.pos;
+}
+
+
+template <typename Sink>
+bool ZstdCompressStream::AdaptLevel(Sink& sink)
+{
+    const auto level = NextAdaptiveLevel();
+    if (level == adaptive_.stats.level) return true;
+
+    // NOTE: single-threaded zstd applies a new level from the next frame only
+    if (!EndFrame(sink)) return false;
+
+    const auto rc = ZSTD_CCtx_setParameter(stream_.get(), ZSTD_c_compressionLevel, level);
+    if (ZSTD_isError(rc)) return false;
+
+    adaptive_.stats.level = level;
+    ++adaptive_.stats.level_changes;
+    return true;
+}
+
+
+//
+// ZstdDecompressStream
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename Sink, typename>
+bool ZstdDecompressStream::Transform(const u8* chunk, usize chunk_size, Sink&& sink)
+{
+    if (!HasStream()) return false;
+
+    usize chunk_offset = 0;
+    while (chunk_offset < chunk_size) {
+        const auto chunk_remains = chunk_size - chunk_offset;
+
+        // use caller's bytes directly, if no bytes staged and enough bytes available
+        if (src_bytes_.empty() && chunk_remains >= next_read_size_) {
+            ZSTD_inBuffer input { chunk + chunk_offset, chunk_remains, 0 };
+            return DecompressInput(input, sink);
+        }
+
+        const auto src_available = src_bytes_.capacity() - src_bytes_.size();
+        const auto copy_size = std::min(src_available, chunk_remains);
+
+        // append src bytes
+        src_bytes_.append(chunk + chunk_offset, copy_size);
+        chunk_offset += copy_size;
+
+        // decompress if enough bytes ready
+        if (src_bytes_.size() >= next_read_size_ || src_available == 0u) {
+            const auto success = DecompressStaged(sink);
+            if (!success) return false;
+        }
+    }
+
+    return true;
+}
+
+
+template <typename Sink, typename>
+bool ZstdDecompressStream::Flush(Sink&& sink)
+{
+    return DecompressStaged(sink);
+}
+
+
+template <typename Sink, typename>
+bool ZstdDecompressStream::End(Sink&& sink)
+{
+    if (!HasStream()) return true;
+
+    auto success = true;
+    if (!src_bytes_.empty()) {
+        success = DecompressStaged(sink);
+    }
+
+    stream_.reset();
+    return success;
+}
+
+
+template <typename Sink>
+bool ZstdDecompressStream::DecompressStaged(Sink& sink)
+{
+    if (src_bytes_.empty()) return true;
+
+    ZSTD_inBuffer input { src_bytes_.data(), src_bytes_.size(), 0 };
+    const auto success = DecompressInput(input, sink);
+
+    src_bytes_.clear();
+    return success;
+}
+
+
+template <typename Sink>
+bool ZstdDecompressStream::DecompressInput(ZSTD_inBuffer& input, Sink& sink)
+{
+    auto output_full = false;
+    while (input.pos < input.size || output_full) {
+        auto output = OutputBuffer();
+        next_read_size_ = ZSTD_decompressStream(stream_.get(), &output, &input);
+        if (ZSTD_isError(next_read_size_)) return false;
+
+        // NOTE: decoded bytes may remain in the stream when output is full
+        output_full = output.pos == output.size;
+
+        EmitOutput(output, sink);
+    }
+
+    return true;
+}
+
+
+template <typename Sink>
+void ZstdDecompressStream::EmitOutput(const ZSTD_outBuffer& output, Sink& sink)
+{
+    if (output.pos > 0u) sink(static_cast<const u8*>(output.dst), output.pos);
+}
@@ -0,0 +1,625 @@
+// NOTE: benchmarks are hidden from default test runs, use `[benchmark]` tag to run them.
+//       e.g. ./test-zstd-codec "[benchmark]" --durations yes
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "zstd.h"
+#include "zstd-allocator.h"
+#include "zstd-codec.h"
+#include "zstd-context-pool.h"
+#include "zstd-dict.h"
+#include "zstd-params.h"
+#include "zstd-parallel.h"
+#include "zstd-stream.h"
+#include "test-helpers.h"
+
+#include "catch.hpp"
+
+
+static Vec<Vec<u8>> makeSmallPayloads(const Vec<u8>& corpus, usize count)
+{
+    // 1-8 KiB payloads cut out from the corpus
+    Vec<Vec<u8>> payloads;
+    payloads.reserve(count);
+
+    usize offset = 0;
+    for (usize i = 0; i < count; ++i) {
+        const auto size = std::min<usize>(((i % 8) + 1) * 1024, corpus.size());
+        if (offset + size > corpus.size()) offset = 0;
+
+        const auto begin = std::begin(corpus) + offset;
+        payloads.emplace_back(begin, begin + size);
+        offset += 512;
+    }
+
+    return payloads;
+}
+
+
+TEST_CASE("Benchmark: ZstdCodec small payloads", "[.][benchmark][compress][decompress]")
+{
+    const auto corpus = loadFixture("sample-books.json");
+    const auto payloads = makeSmallPayloads(corpus, 1000);
+    const auto compression_level = 3;
+
+    ZstdCodec codec;
+    Vec<u8> compressed_bytes(codec.CompressBound(8 * 1024).size);
+    Vec<u8> content_bytes(8 * 1024);
+
+    BENCHMARK("compress: ZSTD_compress (context per call)") {
+        for (const auto& payload : payloads) {
+            ZSTD_compress(&compressed_bytes[0], compressed_bytes.size(),
+                          &payload[0], payload.size(), compression_level);
+        }
+    }
+
+    BENCHMARK("compress: ZstdCodec::Compress (reused context)") {
+        for (const auto& payload : payloads) {
+            codec.Compress(compressed_bytes, payload, compression_level);
+        }
+    }
+
+    Vec<Vec<u8>> frames;
+    for (const auto& payload : payloads) {
+        Vec<u8> frame(codec.CompressBound(payload.size()).size);
+        frame.resize(codec.Compress(frame, payload, compression_level).size);
+        frames.push_back(std::move(frame));
+    }
+
+    BENCHMARK("decompress: ZSTD_decompress (context per call)") {
+        for (const auto& frame : frames) {
+            ZSTD_decompress(&content_bytes[0], content_bytes.size(), &frame[0], frame.size());
+        }
+    }
+
+    BENCHMARK("decompress: ZstdCodec::Decompress (reused context)") {
+        for (const auto& frame : frames) {
+            codec.Decompress(content_bytes, frame);
+        }
+    }
+}
+
+
+TEST_CASE("Benchmark: ZstdContextPool contention", "[.][benchmark][compress][context][pool]")
+{
+    // NOTE: every thread runs the same amount of work,
+    //       so linear scaling shows up as constant elapsed time.
+    const auto corpus = loadFixture("sample-books.json");
+    const auto payloads = makeSmallPayloads(corpus, 200);
+    const auto compression_level = 1;
+
+    const auto run_threads = [&payloads](const ZstdCodec& codec, usize thread_count) {
+        Vec<std::thread> threads;
+        for (usize t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&codec, &payloads]() {
+                Vec<u8> compressed_bytes(codec.CompressBound(8 * 1024).size);
+                for (const auto& payload : payloads) {
+                    codec.Compress(compressed_bytes, payload, compression_level);
+                }
+            });
+        }
+
+        for (auto& thread : threads) thread.join();
+    };
+
+    for (const usize thread_count : {1, 2, 4, 8, 16, 32}) {
+        ZstdContextPool cached_pool(thread_count, true);
+        const ZstdCodec cached_codec(cached_pool);
+        BENCHMARK("pool + thread cache, " + std::to_string(thread_count) + " threads") {
+            run_threads(cached_codec, thread_count);
+        }
+
+        ZstdContextPool shared_pool(thread_count, false);
+        const ZstdCodec shared_codec(shared_pool);
+        BENCHMARK("pool only, " + std::to_string(thread_count) + " threads") {
+            run_threads(shared_codec, thread_count);
+        }
+
+        const auto stats = shared_pool.CompressStats();
+        CHECK(stats.high_water <= thread_count);
+    }
+}
+
+
+TEST_CASE("Benchmark: ZstdCompressStream chunk sizes", "[.][benchmark][compress][stream]")
+{
+    // NOTE: chunks at least as large as zstd's input hint bypass the staging buffer
+    const auto content_bytes = loadFixture("dance_yorokobi_mai_man.bmp");
+    const auto compression_level = 1;
+    const StreamBufferCallback callback = [](const ByteBuffer&) {};
+
+    for (const usize chunk_size : {1024, 16 * 1024, 256 * 1024}) {
+        BENCHMARK("level 1, " + std::to_string(chunk_size / 1024) + " KiB chunks") {
+            ZstdCompressStream stream;
+            stream.Begin(compression_level);
+            for (usize offset = 0; offset < content_bytes.size(); offset += chunk_size) {
+                const auto size = std::min(chunk_size, content_bytes.size() - offset);
+                stream.Transform(&content_bytes[offset], size, callback);
+            }
+            stream.End(callback);
+        }
+    }
+}
+
+
+TEST_CASE("Benchmark: stream callback overhead", "[.][benchmark][compress][stream]")
+{
+    // NOTE: small chunks at the fastest level, to make per-output overhead visible
+    const auto content_bytes = loadFixture("sample-books.json");
+    const auto chunk_size = usize(256);
+    const auto compression_level = -5;
+
+    const auto transform_all = [&content_bytes, chunk_size](ZstdCompressStream& stream, const auto& sink) {
+        for (usize offset = 0; offset < content_bytes.size(); offset += chunk_size) {
+            const auto size = std::min(chunk_size, content_bytes.size() - offset);
+            stream.Transform(&content_bytes[offset], size, sink);
+            stream.Flush(sink);
+        }
+        stream.End(sink);
+    };
+
+    usize total_size = 0;
+
+    BENCHMARK("StreamCallback (std::function, Vec<u8>)") {
+        const StreamCallback callback = [&total_size](const Vec<u8>& bytes) {
+            total_size += bytes.size();
+        };
+
+        ZstdCompressStream stream;
+        stream.Begin(compression_level);
+        transform_all(stream, callback);
+    }
+
+    BENCHMARK("StreamBufferCallback (std::function)") {
+        const StreamBufferCallback callback = [&total_size](const ByteBuffer& bytes) {
+            total_size += bytes.size();
+        };
+
+        ZstdCompressStream stream;
+        stream.Begin(compression_level);
+        transform_all(stream, callback);
+    }
+
+    BENCHMARK("sink (template)") {
+        const auto sink = [&total_size](const u8*, usize size) {
+            total_size += size;
+        };
+
+        ZstdCompressStream stream;
+        stream.Begin(compression_level);
+        transform_all(stream, sink);
+    }
+
+    REQUIRE(total_size > 0);
+}
+
+
+TEST_CASE("Benchmark: ZstdDecompressStream callbacks", "[.][benchmark][decompress][stream]")
+{
+    // NOTE: decoded output fills whole buffers, which StreamCallback receives without a copy
+    const auto content_bytes = loadFixture("dance_yorokobi_mai_man.bmp");
+    const auto chunk_size = usize(16 * 1024);
+
+    ZstdCodec codec;
+    Vec<u8> compressed_bytes(codec.CompressBound(content_bytes.size()).size);
+    compressed_bytes.resize(codec.Compress(compressed_bytes, content_bytes, 1).size);
+
+    const auto transform_all = [&compressed_bytes, chunk_size](ZstdDecompressStream& stream, const auto& callback) {
+        stream.Begin();
+        for (usize offset = 0; offset < compressed_bytes.size(); offset += chunk_size) {
+            const auto size = std::min(chunk_size, compressed_bytes.size() - offset);
+            stream.Transform(&compressed_bytes[offset], size, callback);
+        }
+        stream.End(callback);
+    };
+
+    usize total_size = 0;
+
+    BENCHMARK("StreamCallback (std::function, Vec<u8>)") {
+        const StreamCallback callback = [&total_size](const Vec<u8>& bytes) {
+            total_size += bytes.size();
+        };
+
+        ZstdDecompressStream stream;
+        transform_all(stream, callback);
+    }
+
+    BENCHMARK("StreamBufferCallback (std::function)") {
+        const StreamBufferCallback callback = [&total_size](const ByteBuffer& bytes) {
+            total_size += bytes.size();
+        };
+
+        ZstdDecompressStream stream;
+        transform_all(stream, callback);
+    }
+
+    REQUIRE(total_size > 0);
+}
+
+
+static Vec<u8> makeSyntheticCorpus(usize size)
+{
+    // NOTE: moderately compressible, words from a small vocabulary with pseudo-random numbers
+    static const char* kWords[] = {
+        "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+        "india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa",
+    };
+
+    Vec<u8> corpus;
+    corpus.reserve(size);
+
+    std::uint32_t seed = 2463534242u;
+    while (corpus.size() < size) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        const auto word = kWords[seed % 16];
+        corpus.insert(std::end(corpus), word, word + std::strlen(word));
+
+        const auto number = std::to_string(seed % 100000);
+        corpus.insert(std::end(corpus), std::begin(number), std::end(number));
+        corpus.push_back((seed & 0x100) ? '\n' : ' ');
+    }
+
+    corpus.resize(size);
+    return corpus;
+}
+
+
+TEST_CASE("Benchmark: multi-threaded ZstdCompressStream", "[.][benchmark][compress][stream][multithread]")
+{
+    const auto corpus = makeSyntheticCorpus(64 * 1024 * 1024);
+    const auto compression_level = 3;
+    const auto max_workers = std::max(1u, std::thread::hardware_concurrency());
+
+    usize compressed_size = 0;
+    const auto sink = [&compressed_size](const u8*, usize size) {
+        compressed_size += size;
+    };
+
+    BENCHMARK("64 MiB, single-threaded") {
+        ZstdCompressStream stream;
+        stream.Begin(compression_level);
+        stream.Transform(corpus.data(), corpus.size(), sink);
+        stream.End(sink);
+    }
+
+    for (auto workers = 1u; workers <= max_workers; workers *= 2) {
+        BENCHMARK("64 MiB, " + std::to_string(workers) + " workers") {
+            ZstdCompressStream stream;
+            stream.Begin(compression_level, workers);
+            stream.Transform(corpus.data(), corpus.size(), sink);
+            stream.End(sink);
+        }
+    }
+
+    REQUIRE(compressed_size > 0);
+}
+
+
+TEST_CASE("Benchmark: ZstdParallelCodec", "[.][benchmark][compress][decompress][parallel]")
+{
+    const auto corpus = makeSyntheticCorpus(64 * 1024 * 1024);
+    const auto compression_level = 3;
+    const auto max_workers = std::max(1u, std::thread::hardware_concurrency());
+
+    for (auto workers = 1u; workers <= max_workers; workers *= 2) {
+        ZstdParallelCodec codec(workers);
+
+        ByteBuffer compressed_bytes;
+        BENCHMARK("compress 64 MiB, " + std::to_string(workers) + " workers") {
+            codec.Compress(compressed_bytes, corpus.data(), corpus.size(), compression_level);
+        }
+
+        ByteBuffer content_bytes;
+        BENCHMARK("decompress 64 MiB, " + std::to_string(workers) + " workers") {
+            codec.Decompress(content_bytes, compressed_bytes.data(), compressed_bytes.size());
+        }
+
+        REQUIRE(content_bytes.size() == corpus.size());
+    }
+}
+
+
+TEST_CASE("Benchmark: long-range mode", "[.][benchmark][compress][decompress][params]")
+{
+    // NOTE: 32 MiB blocks repeated with small edits, repeats are far beyond default windows
+    const auto block = makeSyntheticCorpus(32 * 1024 * 1024);
+    Vec<u8> corpus;
+    for (auto i = 0; i < 4; ++i) {
+        corpus.insert(std::end(corpus), std::begin(block), std::end(block));
+        for (usize offset = i; offset < block.size(); offset += 64 * 1024) {
+            corpus[corpus.size() - block.size() + offset] ^= 0x5a;
+        }
+    }
+
+    const auto compression_level = 3;
+    ZstdCompressionParams params(compression_level);
+    REQUIRE(params.SetLongRange(ZstdCompressionParams::kLongRangeWindowLog));
+
+    ZstdCodec codec;
+    ByteBuffer default_bytes;
+    BENCHMARK("compress 128 MiB, default") {
+        codec.Compress(default_bytes, corpus.data(), corpus.size(), compression_level);
+    }
+
+    ByteBuffer long_range_bytes;
+    BENCHMARK("compress 128 MiB, long-range") {
+        codec.Compress(long_range_bytes, corpus.data(), corpus.size(), params);
+    }
+
+    ByteBuffer content_bytes;
+    BENCHMARK("decompress 128 MiB, default") {
+        codec.Decompress(content_bytes, default_bytes.data(), default_bytes.size());
+    }
+
+    BENCHMARK("decompress 128 MiB, long-range") {
+        codec.Decompress(content_bytes, long_range_bytes.data(), long_range_bytes.size());
+    }
+
+    WARN("ratio default: " << static_cast<double>(corpus.size()) / default_bytes.size()
+         << ", long-range: " << static_cast<double>(corpus.size()) / long_range_bytes.size());
+    REQUIRE(long_range_bytes.size() < default_bytes.size());
+}
+
+
+struct LatencyReport
+{
+    double  ttfb_us;    // first Transform to first output
+    double  p50_us;     // message submitted to message decodable by a receiver
+    double  p99_us;
+};
+
+
+static LatencyReport measureLatency(ZstdCompressStream& cstream, const Vec<u8>& corpus, usize message_size, usize message_count)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto interval = std::chrono::microseconds(100);
+
+    Vec<Clock::time_point> submitted;
+    Vec<double> latencies;
+    submitted.reserve(message_count);
+    latencies.reserve(message_count);
+
+    auto first_output = Clock::time_point();
+    usize decoded_size = 0;
+
+    ZstdDecompressStream dstream;
+    dstream.Begin();
+    const auto decoded_sink = [&](const u8*, usize size) {
+        decoded_size += size;
+
+        const auto now = Clock::now();
+        while (latencies.size() < submitted.size() && (latencies.size() + 1) * message_size <= decoded_size) {
+            latencies.push_back(std::chrono::duration<double, std::micro>(now - submitted[latencies.size()]).count());
+        }
+    };
+    const auto sink = [&](const u8* bytes, usize size) {
+        if (first_output == Clock::time_point()) first_output = Clock::now();
+        dstream.Transform(bytes, size, decoded_sink);
+    };
+
+    // NOTE: producer paced by busy waiting, sleeps are too coarse
+    auto next_message = Clock::now();
+    for (usize i = 0; i < message_count; ++i) {
+        while (Clock::now() < next_message) cstream.Poll(sink);
+        next_message += interval;
+
+        submitted.push_back(Clock::now());
+        const auto offset = (i * message_size) % (corpus.size() - message_size);
+        cstream.Transform(corpus.data() + offset, message_size, sink);
+    }
+    cstream.End(sink);
+
+    std::sort(std::begin(latencies), std::end(latencies));
+    const auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[static_cast<usize>(p * (latencies.size() - 1))];
+    };
+
+    const auto ttfb = std::chrono::duration<double, std::micro>(first_output - submitted.front()).count();
+    return LatencyReport { ttfb, percentile(0.5), percentile(0.99) };
+}
+
+
+TEST_CASE("Benchmark: ZstdCompressStream latency", "[.][benchmark][compress][stream][latency]")
+{
+    const auto corpus = makeSyntheticCorpus(4 * 1024 * 1024);
+    const usize message_size = 200;
+    const usize message_count = 2000;
+    const auto compression_level = 3;
+
+    ZstdCompressionParams params(compression_level);
+    REQUIRE(params.SetTargetCBlockSize(1400));
+
+    struct Mode
+    {
+        std::string     name;
+        bool            bounded_blocks;
+        usize           max_pending_bytes;
+        u64             max_pending_us;
+    };
+
+    const Vec<Mode> modes {
+        { "default", false, 0, 0 },
+        { "flush every 1 KiB", false, 1024, 0 },
+        { "flush after 500 us", false, 0, 500 },
+        { "flush every 1 KiB, 1400 byte blocks", true, 1024, 0 },
+    };
+
+    for (const auto& mode : modes) {
+        LatencyReport report {};
+        BENCHMARK(mode.name) {
+            ZstdCompressStream cstream;
+            cstream.SetAutoFlush(mode.max_pending_bytes, mode.max_pending_us);
+            if (mode.bounded_blocks) {
+                cstream.Begin(params);
+            }
+            else {
+                cstream.Begin(compression_level);
+            }
+
+            report = measureLatency(cstream, corpus, message_size, message_count);
+        }
+
+        WARN(mode.name << ": ttfb " << report.ttfb_us << " us, p50 " << report.p50_us << " us, p99 " << report.p99_us << " us");
+    }
+}
+
+
+TEST_CASE("Benchmark: delta compression using prefix", "[.][benchmark][compress][decompress][prefix]")
+{
+    // NOTE: next version of a 32 MiB blob, with an edit every 64 KiB
+    const auto reference = makeSyntheticCorpus(32 * 1024 * 1024);
+    auto content_bytes = reference;
+    for (usize offset = 0; offset < content_bytes.size(); offset += 64 * 1024) {
+        content_bytes[offset] ^= 0x5a;
+    }
+
+    const auto compression_level = 3;
+    ZstdCodec codec;
+
+    ByteBuffer full_bytes;
+    BENCHMARK("compress 32 MiB, full") {
+        codec.Compress(full_bytes, content_bytes.data(), content_bytes.size(), compression_level);
+    }
+
+    ByteBuffer delta_bytes;
+    BENCHMARK("compress 32 MiB, delta") {
+        codec.CompressUsingPrefix(delta_bytes, content_bytes.data(), content_bytes.size(),
+                                  reference.data(), reference.size(), compression_level);
+    }
+
+    ByteBuffer result_bytes;
+    BENCHMARK("decompress 32 MiB, full") {
+        codec.Decompress(result_bytes, full_bytes.data(), full_bytes.size());
+    }
+
+    BENCHMARK("decompress 32 MiB, delta") {
+        codec.DecompressUsingPrefix(result_bytes, delta_bytes.data(), delta_bytes.size(),
+                                    reference.data(), reference.size());
+    }
+
+    WARN("compressed size full: " << full_bytes.size() << ", delta: " << delta_bytes.size());
+    REQUIRE(result_bytes.ToVec() == content_bytes);
+}
+
+
+TEST_CASE("Benchmark: loading 500 dictionaries", "[.][benchmark][dictionary][mmap]")
+{
+    // NOTE: 500 copies of sample-dict (180 KiB) with distinct dictIDs, one file each
+    const auto sample_dict = loadFixture("sample-dict");
+    const auto dict_count = 500;
+    Vec<std::string> dict_paths;
+    for (auto i = 0; i < dict_count; ++i) {
+        auto dict_bytes = sample_dict;
+        const auto dict_id = static_cast<u32>(10000 + i);
+        for (auto b = 0; b < 4; ++b) dict_bytes[4 + b] = static_cast<u8>(dict_id >> (8 * b));
+
+        dict_paths.push_back(tempPath(("dict-" + std::to_string(i) + ".bin").c_str()));
+        FileResource dict_file(dict_paths.back(), "wb");
+        fwrite(dict_bytes.data(), 1, dict_bytes.size(), dict_file.get());
+    }
+
+    const auto compression_level = 3;
+    const auto load_dicts = [&](bool by_reference) {
+        Vec<std::unique_ptr<ZstdCompressionDict>> cdicts;
+        Vec<std::unique_ptr<ZstdDecompressionDict>> ddicts;
+        usize heap_size = 0;
+        for (const auto& path : dict_paths) {
+            if (by_reference) {
+                const auto file = std::make_shared<const MappedFile>(path);
+                cdicts.emplace_back(new ZstdCompressionDict(file, compression_level));
+                ddicts.emplace_back(new ZstdDecompressionDict(file));
+            }
+            else {
+                std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+                const Vec<u8> dict_bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+                cdicts.emplace_back(new ZstdCompressionDict(dict_bytes, compression_level));
+                ddicts.emplace_back(new ZstdDecompressionDict(dict_bytes));
+            }
+
+            heap_size += ZSTD_sizeof_CDict(cdicts.back()->get()) + ZSTD_sizeof_DDict(ddicts.back()->get());
+        }
+
+        return heap_size;
+    };
+
+    usize copied_size = 0;
+    BENCHMARK("load 500 dictionaries, read and copy") {
+        copied_size = load_dicts(false);
+    }
+
+    usize mapped_size = 0;
+    BENCHMARK("load 500 dictionaries, mmap by reference") {
+        mapped_size = load_dicts(true);
+    }
+
+    WARN("dictionary heap size copied: " << copied_size / 1024 << " KiB, by reference: " << mapped_size / 1024 << " KiB");
+    REQUIRE(mapped_size < copied_size);
+
+    for (const auto& path : dict_paths) std::remove(path.c_str());
+}
+
+
+// NOTE: forwards to malloc, counting calls as zstd's default allocator would make
+class MallocCountingAllocator : public IZstdAllocator
+{
+public:
+    MallocCountingAllocator() : mallocs(0) {}
+
+    virtual void* Allocate(usize size) { ++mallocs; return std::malloc(size); }
+    virtual void Free(void* address) { std::free(address); }
+
+    usize mallocs;
+};
+
+
+TEST_CASE("Benchmark: custom allocators", "[.][benchmark][compress][decompress][allocator]")
+{
+    // NOTE: a request-scoped codec per payload, contexts are created and freed every time
+    const auto corpus = loadFixture("sample-books.json");
+    const auto payloads = makeSmallPayloads(corpus, 1000);
+    const auto compression_level = 3;
+
+    Vec<u8> compressed_bytes(ZSTD_compressBound(8 * 1024));
+    Vec<u8> content_bytes(8 * 1024);
+    const auto roundtrip = [&](const ZstdCodec& codec, const Vec<u8>& payload) {
+        const auto rc = codec.Compress(compressed_bytes.data(), compressed_bytes.size(),
+                                       payload.data(), payload.size(), compression_level);
+        codec.Decompress(content_bytes.data(), content_bytes.size(), compressed_bytes.data(), rc.size);
+    };
+
+    MallocCountingAllocator malloc_allocator;
+    BENCHMARK("1000 requests: malloc") {
+        for (const auto& payload : payloads) {
+            roundtrip(ZstdCodec(malloc_allocator), payload);
+        }
+    }
+
+    ZstdPoolAllocator pool_allocator(64 * 1024 * 1024);
+    BENCHMARK("1000 requests: pool allocator") {
+        for (const auto& payload : payloads) {
+            roundtrip(ZstdCodec(pool_allocator), payload);
+        }
+    }
+
+    ZstdArenaAllocator arena_allocator(8 * 1024 * 1024);
+    BENCHMARK("1000 requests: arena allocator") {
+        for (const auto& payload : payloads) {
+            roundtrip(ZstdCodec(arena_allocator), payload);
+            arena_allocator.Reset();
+        }
+    }
+
+    const auto per_request = [&](usize mallocs) { return static_cast<double>(mallocs) / payloads.size(); };
+    WARN("malloc calls per request, malloc: " << per_request(malloc_allocator.mallocs)
+         << ", pool: " << per_request(pool_allocator.Stats().system_allocations)
+         << ", arena: " << per_request(arena_allocator.Stats().system_allocations)
+         << " (arena high water: " << arena_allocator.HighWater() / 1024 << " KiB)");
+}
@@ -1,56 +1,37 @@
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <cstdio>
 #include <fstream>
 #include <functional>
 #include <iterator>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
 
+#include "zdict.h"
+#include "zstd-allocator.h"
 #include "zstd-codec.h"
+#include "zstd-context-pool.h"
 #include "zstd-dict.h"
+#include "zstd-dict-registry.h"
+#include "zstd-dict-retrainer.h"
+#include "zstd-dict-trainer.h"
+#include "zstd-params.h"
+#include "zstd-parallel.h"
+#include "zstd-seekable.h"
 #include "zstd-stream.h"
+#include "test-helpers.h"
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
 
-class FileResource : public Resource<FILE>
-{
-public:
-    FileResource(const std::string& path, const char* mode)
-        : FileResource(path.c_str(), mode)
-    {
-    }
-
-    FileResource(const char* path, const char* mode)
-        : Resource(fopen(path, mode), fclose)
-    {
-    }
-};
-
-
-static std::string fixturePath(const char* name)
-{
-    static const std::string kFixturePath("test/fixtures");
-    return kFixturePath + "/" + name;
-}
-
-
-static std::string tempPath(const char* name)
-{
-    static const std::string kTempPath("test/tmp");
-    return kTempPath + "/" + name;
-}
-
-
-static Vec<u8> loadFixture(const char* name)
-{
-    const auto path = fixturePath(name);
-    std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
-    return Vec<u8>((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
-}
-
-
 TEST_CASE("Zstd-Dictionary-Interfaces", "[zstd][compress][decompress][dictionary]")
 {
     const auto dict_bytes = loadFixture("sample-dict");
@@ -61,32 +42,33 @@ TEST_CASE("Zstd-Dictionary-Interfaces", "[zstd][compress][decompress][dictionary
     ZstdDecompressionDict ddict(dict_bytes);
 
     ZstdCodec codec;
-    Vec<u8> compressed_bytes(codec.CompressBound(sample_books.size()));
+    Vec<u8> compressed_bytes(codec.CompressBound(sample_books.size()).size);
 
     // compress with dictionary
     auto rc = codec.CompressUsingDict(compressed_bytes, sample_books, cdict);
-    REQUIRE(rc >= 0);
+    REQUIRE(rc.ok());
 
-    REQUIRE(rc < sample_books.size());
-    compressed_bytes.resize(rc);
+    REQUIRE(rc.size < sample_books.size());
+    compressed_bytes.resize(rc.size);
 
-    REQUIRE(codec.ContentSize(compressed_bytes) == sample_books.size());
+    REQUIRE(codec.ContentSize(compressed_bytes).size == sample_books.size());
 
     // decompress with dictionary
 
     // NOTE: ensure enough buffer to test return code (avoid truncation)
     Vec<u8> decompressed_bytes(sample_books.size() * 2);
     rc = codec.DecompressUsingDict(decompressed_bytes, compressed_bytes, ddict);
-    REQUIRE(rc >= 0);
+    REQUIRE(rc.ok());
 
-    REQUIRE(rc == sample_books.size());
-    decompressed_bytes.resize(rc);
+    REQUIRE(rc.size == sample_books.size());
+    decompressed_bytes.resize(rc.size);
 
     REQUIRE(decompressed_bytes == sample_books);
 
     // cannot decompress without dictionary
     rc = codec.Decompress(decompressed_bytes, compressed_bytes);
-    REQUIRE(rc < 0);
+    REQUIRE_FALSE(rc.ok());
+    REQUIRE(rc.error == ZstdError::Zstd);
 }
 
 
@@ -169,7 +151,7 @@ TEST_CASE("ZstdCompressStream", "[zstd][compress][stream]")
 
     ZstdCodec codec;
     Vec<u8> decompressed_bytes(content_bytes.size());
-    REQUIRE(codec.Decompress(decompressed_bytes, result_bytes) == content_bytes.size());
+    REQUIRE(codec.Decompress(decompressed_bytes, result_bytes).size == content_bytes.size());
     REQUIRE(decompressed_bytes == content_bytes);
 
     FileResource result_file(tempPath("dance_yorokobi_mai_man.bmp.zst"), "wb");
@@ -215,14 +197,1755 @@ TEST_CASE("ZstdDecompressStream", "[zstd][decompress][stream]")
     zst_file.Close();
 
     ZstdCodec codec;
-    const auto content_size = codec.ContentSize(compressed_bytes);
+    const auto content_size = codec.ContentSize(compressed_bytes).size;
     REQUIRE(result_bytes.size() == content_size);
 
     Vec<u8> content_bytes(content_size);
-    REQUIRE(codec.Decompress(content_bytes, compressed_bytes) == content_size);
+    REQUIRE(codec.Decompress(content_bytes, compressed_bytes).size == content_size);
     REQUIRE(content_bytes == result_bytes);
 
     FileResource result_file(tempPath("dance_yorokobi_mai_woman.bmp"), "wb");
     fwrite(&result_bytes[0], result_bytes.size(), 1, result_file.get());
     result_file.Close();
 }
+
+
+TEST_CASE("ZstdCodec reuses contexts across calls", "[zstd][compress][decompress][context]")
+{
+    const auto dict_bytes = loadFixture("sample-dict");
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto lorem = loadFixture("lorem.txt");
+
+    ZstdCompressionDict cdict(dict_bytes, 5);
+    ZstdDecompressionDict ddict(dict_bytes);
+
+    ZstdCodec codec;
+    for (auto i = 0; i < 3; ++i) {
+        // alternate dictionary and non-dictionary calls on the same contexts
+        Vec<u8> compressed_bytes(codec.CompressBound(sample_books.size()).size);
+        auto rc = codec.CompressUsingDict(compressed_bytes, sample_books, cdict);
+        REQUIRE(rc.ok());
+        compressed_bytes.resize(rc.size);
+
+        Vec<u8> content_bytes(sample_books.size());
+        REQUIRE(codec.DecompressUsingDict(content_bytes, compressed_bytes, ddict).size == sample_books.size());
+        REQUIRE(content_bytes == sample_books);
+
+        compressed_bytes.resize(codec.CompressBound(lorem.size()).size);
+        rc = codec.Compress(compressed_bytes, lorem, 1 + i);
+        REQUIRE(rc.ok());
+        compressed_bytes.resize(rc.size);
+
+        content_bytes.resize(lorem.size());
+        REQUIRE(codec.Decompress(content_bytes, compressed_bytes).size == lorem.size());
+        REQUIRE(content_bytes == lorem);
+    }
+}
+
+
+TEST_CASE("ZstdContextPool", "[zstd][compress][decompress][context][pool]")
+{
+    SECTION("counts hits, misses and high-water mark") {
+        ZstdContextPool pool(4, false);
+        {
+            auto cctx1 = pool.BorrowCompressContext();
+            auto cctx2 = pool.BorrowCompressContext();
+            REQUIRE(cctx1 != nullptr);
+            REQUIRE(cctx2 != nullptr);
+            REQUIRE(cctx1.get() != cctx2.get());
+        }
+
+        auto cctx = pool.BorrowCompressContext();
+        REQUIRE(cctx != nullptr);
+
+        const auto stats = pool.CompressStats();
+        REQUIRE(stats.misses == 2);
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.high_water == 2);
+
+        REQUIRE(pool.DecompressStats().misses == 0);
+    }
+
+    SECTION("keeps thread cache per pool") {
+        ZstdContextPool pool1(1);
+        ZstdContextPool pool2(1);
+
+        pool1.BorrowCompressContext();
+        REQUIRE(pool2.BorrowCompressContext() != nullptr);
+        REQUIRE(pool1.BorrowCompressContext() != nullptr);
+
+        REQUIRE(pool1.CompressStats().misses == 1);
+        REQUIRE(pool1.CompressStats().hits == 1);
+        REQUIRE(pool2.CompressStats().misses == 1);
+        REQUIRE(pool2.CompressStats().hits == 0);
+    }
+
+    SECTION("returns thread cache to the pool on thread exit") {
+        ZstdContextPool pool(1);
+        std::thread([&pool]() { pool.BorrowCompressContext(); }).join();
+
+        REQUIRE(pool.BorrowCompressContext() != nullptr);
+        REQUIRE(pool.CompressStats().misses == 1);
+        REQUIRE(pool.CompressStats().hits == 1);
+    }
+
+    SECTION("shares contexts across threads") {
+        const auto sample_books = loadFixture("sample-books.json");
+        const auto thread_count = 8;
+        const auto iterations = 20;
+
+        ZstdContextPool pool(thread_count);
+        const ZstdCodec codec(pool);
+
+        std::atomic<int> failures(0);
+        Vec<std::thread> threads;
+        for (auto t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t]() {
+                Vec<u8> compressed_bytes(codec.CompressBound(sample_books.size()).size);
+                Vec<u8> content_bytes(sample_books.size());
+                for (auto i = 0; i < iterations; ++i) {
+                    compressed_bytes.resize(compressed_bytes.capacity());
+                    const auto rc = codec.Compress(compressed_bytes, sample_books, 1 + (t + i) % 5);
+                    if (!rc.ok()) { ++failures; continue; }
+                    compressed_bytes.resize(rc.size);
+
+                    const auto result = codec.Decompress(content_bytes, compressed_bytes);
+                    if (result.size != sample_books.size() || content_bytes != sample_books) ++failures;
+                }
+            });
+        }
+
+        for (auto& thread : threads) thread.join();
+        REQUIRE(failures == 0);
+
+        const auto stats = pool.CompressStats();
+        REQUIRE(stats.hits + stats.misses == thread_count * iterations);
+        REQUIRE(stats.misses <= thread_count);
+        REQUIRE(stats.high_water <= thread_count);
+    }
+}
+
+
+TEST_CASE("ZstdCodec pointer and length interfaces", "[zstd][compress][decompress]")
+{
+    const auto dict_bytes = loadFixture("sample-dict");
+    const auto sample_books = loadFixture("sample-books.json");
+
+    // compress a region in the middle of caller-owned memory
+    const auto offset = 100u;
+    const auto size = sample_books.size() - 2 * offset;
+    const auto src = sample_books.data() + offset;
+    const Vec<u8> expected(src, src + size);
+
+    ZstdCodec codec;
+    const auto bound = codec.CompressBound(size).size;
+    std::unique_ptr<u8[]> compressed_bytes(new u8[bound]);
+    std::unique_ptr<u8[]> content_bytes(new u8[size]);
+
+    SECTION("simple api") {
+        const auto rc = codec.Compress(compressed_bytes.get(), bound, src, size, 3);
+        REQUIRE(rc.ok());
+        const auto compressed_size = rc.size;
+        REQUIRE(codec.ContentSize(compressed_bytes.get(), compressed_size).size == size);
+
+        REQUIRE(codec.Decompress(content_bytes.get(), size, compressed_bytes.get(), compressed_size).size == size);
+        REQUIRE(std::equal(content_bytes.get(), content_bytes.get() + size, std::begin(expected)));
+
+        // destination too small
+        REQUIRE_FALSE(codec.Decompress(content_bytes.get(), size - 1, compressed_bytes.get(), compressed_size).ok());
+    }
+
+    SECTION("dictionary api") {
+        ZstdCompressionDict cdict(dict_bytes, 5);
+        ZstdDecompressionDict ddict(dict_bytes);
+
+        const auto rc = codec.CompressUsingDict(compressed_bytes.get(), bound, src, size, cdict);
+        REQUIRE(rc.ok());
+        const auto compressed_size = rc.size;
+
+        REQUIRE(codec.DecompressUsingDict(content_bytes.get(), size, compressed_bytes.get(), compressed_size, ddict).size == size);
+        REQUIRE(std::equal(content_bytes.get(), content_bytes.get() + size, std::begin(expected)));
+    }
+}
+
+
+TEST_CASE("ByteBuffer", "[types]")
+{
+    ByteBuffer buffer;
+    REQUIRE(buffer.empty());
+    REQUIRE(buffer.capacity() == 0);
+
+    buffer.reserve(16);
+    REQUIRE(buffer.size() == 0);
+    REQUIRE(buffer.capacity() == 16);
+
+    const u8 bytes[] = { 1, 2, 3, 4, 5 };
+    buffer.append(bytes, sizeof(bytes));
+    buffer.append(bytes, sizeof(bytes));
+    REQUIRE(buffer.size() == 10);
+    REQUIRE(buffer.capacity() == 16);
+    REQUIRE(buffer[7] == 3);
+
+    buffer.resize(4);
+    buffer.shrink_to_fit();
+    REQUIRE(buffer.capacity() == 4);
+    REQUIRE(buffer.ToVec() == Vec<u8>({ 1, 2, 3, 4 }));
+
+    auto released = buffer.release();
+    REQUIRE(released[3] == 4);
+    REQUIRE(buffer.empty());
+    REQUIRE(buffer.capacity() == 0);
+    REQUIRE(buffer.data() == nullptr);
+}
+
+
+TEST_CASE("ZstdCodec ByteBuffer interfaces", "[zstd][compress][decompress]")
+{
+    const auto dict_bytes = loadFixture("sample-dict");
+    const auto sample_books = loadFixture("sample-books.json");
+
+    ZstdCodec codec;
+    ByteBuffer compressed_bytes;
+    ByteBuffer content_bytes;
+
+    SECTION("simple api") {
+        const auto rc = codec.Compress(compressed_bytes, sample_books.data(), sample_books.size(), 3);
+        REQUIRE(rc.ok());
+        REQUIRE(compressed_bytes.size() == rc.size);
+
+        REQUIRE(codec.Decompress(content_bytes, compressed_bytes.data(), compressed_bytes.size()).size == sample_books.size());
+        REQUIRE(content_bytes.ToVec() == sample_books);
+    }
+
+    SECTION("dictionary api") {
+        ZstdCompressionDict cdict(dict_bytes, 5);
+        ZstdDecompressionDict ddict(dict_bytes);
+
+        const auto rc = codec.CompressUsingDict(compressed_bytes, sample_books.data(), sample_books.size(), cdict);
+        REQUIRE(rc.ok());
+        REQUIRE(compressed_bytes.size() == rc.size);
+
+        REQUIRE(codec.DecompressUsingDict(content_bytes, compressed_bytes.data(), compressed_bytes.size(), ddict).size == sample_books.size());
+        REQUIRE(content_bytes.ToVec() == sample_books);
+    }
+
+    SECTION("content size is required to decompress") {
+        const u8 garbage[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+        REQUIRE_FALSE(codec.Decompress(content_bytes, garbage, sizeof(garbage)).ok());
+        REQUIRE(content_bytes.empty());
+    }
+}
+
+
+TEST_CASE("Stream with mixed chunk sizes", "[zstd][compress][decompress][stream]")
+{
+    const auto content_bytes = loadFixture("dance_yorokobi_mai_man.bmp");
+
+    // tiny chunks are staged, large chunks are passed to zstd directly
+    const Vec<usize> chunk_sizes { 1, 17, 300 * 1024, 5, 4096, 200 * 1024, 3 };
+
+    const auto transform_chunks = [&chunk_sizes](const Vec<u8>& src, const std::function<bool(const u8*, usize)>& transform) {
+        usize offset = 0;
+        for (usize i = 0; offset < src.size(); ++i) {
+            const auto size = std::min(chunk_sizes[i % chunk_sizes.size()], src.size() - offset);
+            if (!transform(&src[offset], size)) return false;
+            offset += size;
+        }
+        return true;
+    };
+
+    Vec<u8> compressed_bytes;
+    const StreamBufferCallback cstream_callback = [&compressed_bytes](const ByteBuffer& compressed) {
+        compressed_bytes.insert(std::end(compressed_bytes), std::begin(compressed), std::end(compressed));
+    };
+
+    ZstdCompressStream cstream;
+    REQUIRE(cstream.Begin(1));
+    REQUIRE(transform_chunks(content_bytes, [&](const u8* chunk, usize chunk_size) {
+        return cstream.Transform(chunk, chunk_size, cstream_callback);
+    }));
+    REQUIRE(cstream.End(cstream_callback));
+
+    Vec<u8> result_bytes;
+    const StreamBufferCallback dstream_callback = [&result_bytes](const ByteBuffer& decompressed) {
+        result_bytes.insert(std::end(result_bytes), std::begin(decompressed), std::end(decompressed));
+    };
+
+    ZstdDecompressStream dstream;
+    REQUIRE(dstream.Begin());
+    REQUIRE(transform_chunks(compressed_bytes, [&](const u8* chunk, usize chunk_size) {
+        return dstream.Transform(chunk, chunk_size, dstream_callback);
+    }));
+    REQUIRE(dstream.End(dstream_callback));
+
+    REQUIRE(result_bytes == content_bytes);
+}
+
+
+TEST_CASE("Stream using sink", "[zstd][compress][decompress][stream]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+
+    Vec<u8> compressed_bytes;
+    auto empty_outputs = 0;
+    const auto append = AppendSink(compressed_bytes);
+    const auto compress_sink = [&append, &empty_outputs](const u8* bytes, usize size) {
+        if (size == 0) ++empty_outputs;
+        append(bytes, size);
+    };
+
+    ZstdCompressStream cstream;
+    REQUIRE(cstream.Begin(3));
+    for (usize offset = 0; offset < sample_books.size(); offset += 1000) {
+        const auto size = std::min<usize>(1000, sample_books.size() - offset);
+        REQUIRE(cstream.Transform(&sample_books[offset], size, compress_sink));
+    }
+    REQUIRE(cstream.Flush(compress_sink));
+    REQUIRE(cstream.End(compress_sink));
+    REQUIRE(empty_outputs == 0);
+
+    Vec<u8> content_bytes;
+    const auto decompress_sink = AppendSink(content_bytes);
+
+    ZstdDecompressStream dstream;
+    REQUIRE(dstream.Begin());
+    REQUIRE(dstream.Transform(compressed_bytes.data(), compressed_bytes.size(), decompress_sink));
+    REQUIRE(dstream.Flush(decompress_sink));
+    REQUIRE(dstream.End(decompress_sink));
+    REQUIRE(content_bytes == sample_books);
+}
+
+
+TEST_CASE("Stream using caller-provided buffers", "[zstd][compress][decompress][stream]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+
+    // small fixed output buffer, like a socket send buffer
+    Vec<u8> out_bytes(4096);
+    Vec<u8> compressed_bytes;
+
+    ZstdCompressStream cstream;
+    REQUIRE(cstream.Begin(3));
+
+    StreamInBuffer input { sample_books.data(), sample_books.size(), 0 };
+    auto directive = StreamDirective::Continue;
+    for (;;) {
+        if (input.pos == input.size) directive = StreamDirective::End;
+
+        StreamOutBuffer output { out_bytes.data(), out_bytes.size(), 0 };
+        const auto progress = cstream.Compress(input, output, directive);
+        REQUIRE(progress.success);
+        REQUIRE(progress.produced == output.pos);
+        compressed_bytes.insert(std::end(compressed_bytes), out_bytes.data(), out_bytes.data() + output.pos);
+
+        if (directive == StreamDirective::End && progress.remaining == 0) break;
+    }
+    REQUIRE(input.pos == sample_books.size());
+
+    // stream is closed after the frame is finished
+    StreamOutBuffer closed_output { out_bytes.data(), out_bytes.size(), 0 };
+    REQUIRE_FALSE(cstream.Compress(input, closed_output, StreamDirective::End).success);
+
+    ZstdDecompressStream dstream;
+    REQUIRE(dstream.Begin());
+
+    Vec<u8> content_bytes;
+    StreamInBuffer compressed_input { compressed_bytes.data(), compressed_bytes.size(), 0 };
+    for (;;) {
+        StreamOutBuffer output { out_bytes.data(), out_bytes.size(), 0 };
+        const auto progress = dstream.Decompress(compressed_input, output);
+        REQUIRE(progress.success);
+        content_bytes.insert(std::end(content_bytes), out_bytes.data(), out_bytes.data() + progress.produced);
+
+        if (progress.remaining == 0) break;
+    }
+
+    REQUIRE(compressed_input.pos == compressed_bytes.size());
+    REQUIRE(content_bytes == sample_books);
+}
+
+
+TEST_CASE("Multi-threaded ZstdCompressStream", "[zstd][compress][stream][multithread]")
+{
+    const auto bounds = ZSTD_cParam_getBounds(ZSTD_c_nbWorkers);
+    if (ZSTD_isError(bounds.error) || bounds.upperBound == 0) {
+#ifdef __EMSCRIPTEN__
+        // NOTE: libzstd for Emscripten is single-threaded
+        WARN("zstd is built without ZSTD_MULTITHREAD");
+        return;
+#else
+        FAIL("zstd is built without ZSTD_MULTITHREAD");
+#endif
+    }
+
+    const auto content_bytes = loadFixture("dance_yorokobi_mai_man.bmp");
+
+    Vec<u8> compressed_bytes;
+    const auto sink = AppendSink(compressed_bytes);
+
+    // NOTE: small jobs, to run several jobs on the fixture
+    ZstdCompressStream cstream;
+    REQUIRE_FALSE(cstream.Begin(3, 2, static_cast<usize>(INT_MAX) + 1));
+    REQUIRE(cstream.Begin(3, 2, 512 * 1024, 6));
+    REQUIRE(cstream.Transform(content_bytes.data(), content_bytes.size(), sink));
+    REQUIRE(cstream.End(sink));
+    REQUIRE(compressed_bytes.size() < content_bytes.size());
+
+    ZstdCodec codec;
+    Vec<u8> result_bytes(content_bytes.size());
+    REQUIRE(codec.Decompress(result_bytes, compressed_bytes).size == content_bytes.size());
+    REQUIRE(result_bytes == content_bytes);
+}
+
+
+TEST_CASE("ZstdParallelCodec", "[zstd][compress][decompress][parallel]")
+{
+    const auto content_bytes = loadFixture("dance_yorokobi_mai_man.bmp");
+    const auto chunk_size = 64 * 1024;
+
+    ZstdParallelCodec parallel_codec(4, chunk_size);
+    REQUIRE(parallel_codec.Workers() == 4);
+
+    ByteBuffer compressed_bytes;
+    const auto rc = parallel_codec.Compress(compressed_bytes, content_bytes.data(), content_bytes.size(), 3);
+    REQUIRE(rc.ok());
+    REQUIRE(compressed_bytes.size() == rc.size);
+
+    // independent frames, one per chunk
+    usize frame_count = 0;
+    for (usize offset = 0; offset < compressed_bytes.size(); ++frame_count) {
+        offset += ZSTD_findFrameCompressedSize(compressed_bytes.data() + offset, compressed_bytes.size() - offset);
+    }
+    REQUIRE(frame_count == (content_bytes.size() + chunk_size - 1) / chunk_size);
+
+    SECTION("parallel decompress") {
+        ByteBuffer result_bytes;
+        REQUIRE(parallel_codec.Decompress(result_bytes, compressed_bytes.data(), compressed_bytes.size()).size == content_bytes.size());
+        REQUIRE(result_bytes.ToVec() == content_bytes);
+    }
+
+    SECTION("readable by single-threaded decoder") {
+        ZstdCodec codec;
+        Vec<u8> result_bytes(content_bytes.size());
+        REQUIRE(codec.Decompress(result_bytes, compressed_bytes.ToVec()).size == content_bytes.size());
+        REQUIRE(result_bytes == content_bytes);
+    }
+
+    SECTION("empty input") {
+        ByteBuffer empty_frame;
+        REQUIRE(parallel_codec.Compress(empty_frame, nullptr, 0, 3).size > 0);
+
+        ByteBuffer result_bytes;
+        const auto result = parallel_codec.Decompress(result_bytes, empty_frame.data(), empty_frame.size());
+        REQUIRE(result.ok());
+        REQUIRE(result.size == 0);
+    }
+
+    SECTION("frames without content size") {
+        Vec<u8> streamed_bytes;
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.Begin(3));
+        REQUIRE(cstream.Transform(content_bytes.data(), content_bytes.size(), AppendSink(streamed_bytes)));
+        REQUIRE(cstream.End(AppendSink(streamed_bytes)));
+
+        ByteBuffer result_bytes;
+        const auto result = parallel_codec.Decompress(result_bytes, streamed_bytes.data(), streamed_bytes.size());
+        REQUIRE(result.error == ZstdError::ContentSizeUnknown);
+    }
+}
+
+
+TEST_CASE("Seekable format", "[zstd][compress][decompress][seekable]")
+{
+    const auto content_bytes = loadFixture("dance_yorokobi_mai_woman.bmp");
+    const auto max_frame_size = 16 * 1024;
+
+    Vec<u8> seekable_bytes;
+    const SeekableSink sink = AppendSink(seekable_bytes);
+
+    ZstdSeekableWriter writer(max_frame_size);
+    REQUIRE(writer.Begin(3));
+    for (usize offset = 0; offset < content_bytes.size(); offset += 10000) {
+        const auto size = std::min<usize>(10000, content_bytes.size() - offset);
+        REQUIRE(writer.Transform(&content_bytes[offset], size, sink));
+    }
+    REQUIRE(writer.End(sink));
+
+    SECTION("readable by regular decoder") {
+        ZstdCodec codec;
+        Vec<u8> result_bytes(content_bytes.size());
+        REQUIRE(codec.Decompress(result_bytes, seekable_bytes).size == content_bytes.size());
+        REQUIRE(result_bytes == content_bytes);
+    }
+
+    SECTION("random access") {
+        ZstdSeekableReader reader(seekable_bytes.data(), seekable_bytes.size(), 2);
+        REQUIRE_FALSE(reader.fail());
+        REQUIRE(reader.FrameCount() == (content_bytes.size() + max_frame_size - 1) / max_frame_size);
+        REQUIRE(reader.ContentSize() == content_bytes.size());
+
+        ByteBuffer range_bytes;
+        const Vec<std::pair<usize, usize>> ranges {
+            { 0, 100 },
+            { max_frame_size - 10, 20 },                        // across frame boundary
+            { 3 * max_frame_size + 5, 5 * max_frame_size },     // across many frames
+            { content_bytes.size() - 50, 50 },
+            { 0, 100 },                                         // evicted frame
+        };
+
+        for (const auto& range : ranges) {
+            REQUIRE(reader.ReadAt(range_bytes, range.first, range.second));
+            REQUIRE(range_bytes.size() == range.second);
+            REQUIRE(std::equal(std::begin(range_bytes), std::end(range_bytes), std::begin(content_bytes) + range.first));
+        }
+
+        // clipped at end of content
+        REQUIRE(reader.ReadAt(range_bytes, content_bytes.size() - 10, 100));
+        REQUIRE(range_bytes.size() == 10);
+        REQUIRE_FALSE(reader.ReadAt(range_bytes, content_bytes.size() + 1, 1));
+    }
+
+    SECTION("read source callback") {
+        usize read_calls = 0;
+        const ZstdSeekableReader::ReadSource source = [&](u64 offset, u8* dest, usize size) {
+            ++read_calls;
+            std::memcpy(dest, &seekable_bytes[offset], size);
+            return true;
+        };
+
+        ZstdSeekableReader reader(source, seekable_bytes.size());
+        REQUIRE_FALSE(reader.fail());
+
+        const auto table_reads = read_calls;
+        ByteBuffer range_bytes;
+        REQUIRE(reader.ReadAt(range_bytes, 2 * max_frame_size + 1, 10));
+        REQUIRE(reader.ReadAt(range_bytes, 2 * max_frame_size + 100, 10));
+        REQUIRE(read_calls == table_reads + 1);    // only the covering frame is read once
+    }
+
+    SECTION("writer is reusable") {
+        Vec<u8> rewritten_bytes;
+        const SeekableSink rewritten_sink = AppendSink(rewritten_bytes);
+
+        REQUIRE(writer.Begin(3));
+        REQUIRE(writer.Transform(content_bytes.data(), content_bytes.size(), rewritten_sink));
+        REQUIRE(writer.End(rewritten_sink));
+        REQUIRE(rewritten_bytes == seekable_bytes);
+    }
+
+    SECTION("invalid seek table") {
+        auto broken_bytes = seekable_bytes;
+        broken_bytes.back() ^= 0xff;
+
+        ZstdSeekableReader reader(broken_bytes.data(), broken_bytes.size());
+        REQUIRE(reader.fail());
+    }
+
+    SECTION("decompressed size not matching frame") {
+        const auto frame_count = (content_bytes.size() + max_frame_size - 1) / max_frame_size;
+        const auto first_entry = seekable_bytes.size() - (8 + frame_count * 8 + 9) + 8;
+
+        // NOTE: seek table stays consistent, only the first frame claims 2GB
+        auto broken_bytes = seekable_bytes;
+        broken_bytes[first_entry + 7] = 0x80;
+
+        ZstdSeekableReader reader(broken_bytes.data(), broken_bytes.size());
+        REQUIRE_FALSE(reader.fail());
+
+        ByteBuffer range_bytes;
+        REQUIRE_FALSE(reader.ReadAt(range_bytes, 0, 100));
+    }
+}
+
+
+// NOTE: deterministic, compressible bytes of a virtual payload at `offset`
+static void fillLargePayload(u8* dest, usize size, u64 offset)
+{
+    for (usize i = 0; i < size; ++i) {
+        const auto position = offset + i;
+        dest[i] = static_cast<u8>((position % 251) ^ (position >> 16));
+    }
+}
+
+
+// NOTE: multi-GB payloads, run explicitly with "[large]"
+TEST_CASE("ZstdCodec with payloads over 2GB", "[.][large][zstd][compress][decompress]")
+{
+    const u64 content_size = 2200ull * 1024 * 1024;
+    REQUIRE(content_size > static_cast<u64>(INT_MAX));
+
+    ZstdCodec codec;
+    REQUIRE(codec.CompressBound(content_size).size > content_size);
+
+    ByteBuffer content_bytes(content_size);
+    fillLargePayload(content_bytes.data(), content_bytes.size(), 0);
+
+    ByteBuffer compressed_bytes;
+    const auto compressed = codec.Compress(compressed_bytes, content_bytes.data(), content_bytes.size(), 1);
+    REQUIRE(compressed.ok());
+    REQUIRE(compressed.size == compressed_bytes.size());
+    compressed_bytes.shrink_to_fit();
+
+    const auto frame_content_size = codec.ContentSize(compressed_bytes.data(), compressed_bytes.size());
+    REQUIRE(frame_content_size.ok());
+    REQUIRE(frame_content_size.size == content_size);
+
+    // NOTE: reuse the source buffer as destination, to keep memory usage low
+    content_bytes.clear();
+    const auto decompressed = codec.Decompress(content_bytes, compressed_bytes.data(), compressed_bytes.size());
+    REQUIRE(decompressed.ok());
+    REQUIRE(decompressed.size == content_size);
+
+    ByteBuffer expected_bytes(1024 * 1024);
+    for (u64 offset = 0; offset < content_size; offset += expected_bytes.size()) {
+        fillLargePayload(expected_bytes.data(), expected_bytes.size(), offset);
+        REQUIRE(std::memcmp(content_bytes.data() + offset, expected_bytes.data(), expected_bytes.size()) == 0);
+    }
+}
+
+
+TEST_CASE("Stream with payloads over 4GB", "[.][large][zstd][compress][decompress][stream]")
+{
+    const u64 content_size = 4200ull * 1024 * 1024;
+    const usize chunk_size = 4 * 1024 * 1024;
+
+    ByteBuffer compressed_bytes;
+    ZstdCompressStream cstream;
+    REQUIRE(cstream.Begin(1));
+
+    const auto compress_sink = [&compressed_bytes](const u8* bytes, usize size) {
+        compressed_bytes.append(bytes, size);
+    };
+
+    ByteBuffer chunk(chunk_size);
+    for (u64 offset = 0; offset < content_size; offset += chunk_size) {
+        fillLargePayload(chunk.data(), chunk.size(), offset);
+        REQUIRE(cstream.Transform(chunk.data(), chunk.size(), compress_sink));
+    }
+    REQUIRE(cstream.End(compress_sink));
+
+    // verify decompressed bytes on the fly, without keeping them
+    u64 decompressed_size = 0;
+    auto matched = true;
+    ByteBuffer expected_bytes;
+    const auto decompress_sink = [&](const u8* bytes, usize size) {
+        expected_bytes.resize(size);
+        fillLargePayload(expected_bytes.data(), size, decompressed_size);
+        matched = matched && std::memcmp(bytes, expected_bytes.data(), size) == 0;
+        decompressed_size += size;
+    };
+
+    ZstdDecompressStream dstream;
+    REQUIRE(dstream.Begin());
+    REQUIRE(dstream.Transform(compressed_bytes.data(), compressed_bytes.size(), decompress_sink));
+    REQUIRE(dstream.End(decompress_sink));
+
+    REQUIRE(matched);
+    REQUIRE(decompressed_size == content_size);
+}
+
+
+TEST_CASE("ZstdCodec with concatenated frames", "[zstd][compress][decompress]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto lorem = loadFixture("lorem.txt");
+
+    ZstdCodec codec;
+    Vec<u8> frames_bytes;
+    const auto append_frame = [&](const Vec<u8>& content_bytes) {
+        ByteBuffer frame;
+        REQUIRE(codec.Compress(frame, content_bytes.data(), content_bytes.size(), 3).ok());
+        frames_bytes.insert(std::end(frames_bytes), std::begin(frame), std::end(frame));
+    };
+
+    append_frame(sample_books);
+    append_frame(lorem);
+
+    // skippable frame: magic, payload size and payload (little endian)
+    const u8 skippable_frame[] = { 0x50, 0x2a, 0x4d, 0x18, 0x04, 0x00, 0x00, 0x00, 'z', 's', 't', 'd' };
+    frames_bytes.insert(std::end(frames_bytes), std::begin(skippable_frame), std::end(skippable_frame));
+
+    append_frame(sample_books);
+
+    Vec<u8> expected(sample_books);
+    expected.insert(std::end(expected), std::begin(lorem), std::end(lorem));
+    expected.insert(std::end(expected), std::begin(sample_books), std::end(sample_books));
+
+    REQUIRE(codec.ContentSize(frames_bytes).size == sample_books.size());
+    REQUIRE(codec.DecompressedSize(frames_bytes).size == expected.size());
+
+    SECTION("one-shot decompress") {
+        ByteBuffer content_bytes;
+        const auto rc = codec.Decompress(content_bytes, frames_bytes.data(), frames_bytes.size());
+        REQUIRE(rc.ok());
+        REQUIRE(rc.size == expected.size());
+        REQUIRE(content_bytes.ToVec() == expected);
+    }
+
+    SECTION("frame without content size") {
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.Begin(3));
+        const auto sink = AppendSink(frames_bytes);
+        REQUIRE(cstream.Transform(lorem.data(), lorem.size(), sink));
+        REQUIRE(cstream.End(sink));
+
+        REQUIRE(codec.DecompressedSize(frames_bytes).error == ZstdError::ContentSizeUnknown);
+
+        ByteBuffer content_bytes;
+        REQUIRE(codec.Decompress(content_bytes, frames_bytes.data(), frames_bytes.size()).error == ZstdError::ContentSizeUnknown);
+    }
+
+    SECTION("truncated frame") {
+        frames_bytes.pop_back();
+        REQUIRE(codec.DecompressedSize(frames_bytes).error == ZstdError::Zstd);
+    }
+}
+
+
+TEST_CASE("ZstdCodec frame info", "[zstd][compress][decompress]")
+{
+    const auto dict_bytes = loadFixture("sample-dict");
+    const auto sample_books = loadFixture("sample-books.json");
+
+    ZstdCodec codec;
+    ZstdFrameInfo info;
+
+    SECTION("frame with content size") {
+        ByteBuffer frame;
+        REQUIRE(codec.Compress(frame, sample_books.data(), sample_books.size(), 3).ok());
+
+        // header bytes are enough
+        const auto rc = codec.FrameInfo(info, frame.data(), 18);
+        REQUIRE(rc.ok());
+        REQUIRE(rc.size == info.header_size);
+        REQUIRE_FALSE(info.skippable);
+        REQUIRE(info.has_content_size);
+        REQUIRE(info.content_size == sample_books.size());
+        REQUIRE(info.window_size >= sample_books.size());
+        REQUIRE(info.dict_id == 0);
+        REQUIRE(info.decoder_memory > 0);
+
+        // too short to parse the header
+        const auto short_rc = codec.FrameInfo(info, frame.data(), 2);
+        REQUIRE(short_rc.error == ZstdError::SrcSizeTooSmall);
+        REQUIRE(short_rc.size > 2);
+        REQUIRE(codec.FrameInfo(info, frame.data(), static_cast<usize>(short_rc.size)).error != ZstdError::Zstd);
+    }
+
+    SECTION("frame using dictionary") {
+        ZstdCompressionDict cdict(dict_bytes, 5);
+        ByteBuffer frame;
+        REQUIRE(codec.CompressUsingDict(frame, sample_books.data(), sample_books.size(), cdict).ok());
+
+        REQUIRE(codec.FrameInfo(info, frame.data(), frame.size()).ok());
+        REQUIRE(info.dict_id == ZDICT_getDictID(dict_bytes.data(), dict_bytes.size()));
+    }
+
+    SECTION("streamed frame") {
+        Vec<u8> frame;
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.Begin(19));
+        const auto sink = AppendSink(frame);
+        REQUIRE(cstream.Transform(sample_books.data(), sample_books.size(), sink));
+        REQUIRE(cstream.End(sink));
+
+        REQUIRE(codec.FrameInfo(info, frame).ok());
+        REQUIRE_FALSE(info.has_content_size);
+        REQUIRE(info.content_size == 0);
+        REQUIRE(info.window_size > sample_books.size());
+        REQUIRE(info.decoder_memory > info.window_size);
+    }
+
+    SECTION("window over default limit") {
+        // NOTE: like `zstd --long=31`, window descriptor 0xA8 is 2^31 bytes, then an empty last raw block
+        const u8 long_frame[] = { 0x28, 0xb5, 0x2f, 0xfd, 0x00, 0xa8, 0x01, 0x00, 0x00 };
+        REQUIRE(codec.FrameInfo(info, long_frame, sizeof(long_frame)).ok());
+        REQUIRE_FALSE(info.skippable);
+        REQUIRE_FALSE(info.has_content_size);
+        REQUIRE(info.window_size == (u64(1) << 31));
+
+        // NOTE: unknown (0) when zstd cannot estimate the window, depending on version and platform
+        REQUIRE((info.decoder_memory == 0 || info.decoder_memory > info.window_size));
+    }
+
+    SECTION("skippable frame") {
+        const u8 skippable_frame[] = { 0x53, 0x2a, 0x4d, 0x18, 0x04, 0x00, 0x00, 0x00, 'z', 's', 't', 'd' };
+        REQUIRE(codec.FrameInfo(info, skippable_frame, sizeof(skippable_frame)).ok());
+        REQUIRE(info.skippable);
+        REQUIRE(info.content_size == 4);
+        REQUIRE(info.dict_id == 0);
+    }
+
+    SECTION("not a frame") {
+        const u8 garbage[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+        REQUIRE(codec.FrameInfo(info, garbage, sizeof(garbage)).error == ZstdError::Zstd);
+    }
+}
+
+
+TEST_CASE("ZstdCompressionParams", "[zstd][compress][params]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+
+    ZstdCompressionParams params(9);
+    REQUIRE_FALSE(params.fail());
+
+    SECTION("validates parameters") {
+        const auto window_log_bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+        REQUIRE(params.SetWindowLog(20));
+        REQUIRE_FALSE(params.SetWindowLog(window_log_bounds.upperBound + 1));
+
+        int window_log = 0;
+        REQUIRE(params.Get(ZSTD_c_windowLog, window_log));
+        REQUIRE(window_log == 20);
+
+        REQUIRE_FALSE(params.SetCompressionLevel(ZSTD_maxCLevel() + 1));
+        REQUIRE(ZstdCompressionParams(ZSTD_maxCLevel() + 1).fail());
+    }
+
+    SECTION("applied to codec") {
+        REQUIRE(params.SetChecksumFlag(true));
+        REQUIRE(params.SetContentSizeFlag(false));
+        REQUIRE(params.SetStrategy(ZSTD_lazy2));
+
+        ZstdCodec codec;
+        ZstdFrameInfo info;
+        for (auto i = 0; i < 2; ++i) {
+            ByteBuffer compressed_bytes;
+            const auto rc = codec.Compress(compressed_bytes, sample_books.data(), sample_books.size(), params);
+            REQUIRE(rc.ok());
+
+            REQUIRE(codec.FrameInfo(info, compressed_bytes.data(), compressed_bytes.size()).ok());
+            REQUIRE(info.has_checksum);
+            REQUIRE_FALSE(info.has_content_size);
+
+            Vec<u8> content_bytes(sample_books.size());
+            REQUIRE(codec.Decompress(content_bytes, compressed_bytes.ToVec()).size == sample_books.size());
+            REQUIRE(content_bytes == sample_books);
+        }
+
+        // other calls are not affected by params
+        ByteBuffer compressed_bytes;
+        REQUIRE(codec.Compress(compressed_bytes, sample_books.data(), sample_books.size(), 3).ok());
+        REQUIRE(codec.FrameInfo(info, compressed_bytes.data(), compressed_bytes.size()).ok());
+        REQUIRE_FALSE(info.has_checksum);
+        REQUIRE(info.has_content_size);
+    }
+
+    SECTION("applied to stream") {
+        REQUIRE(params.SetWindowLog(17));
+        REQUIRE(params.SetChecksumFlag(true));
+
+        Vec<u8> compressed_bytes;
+        const auto sink = AppendSink(compressed_bytes);
+
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.Begin(params));
+        REQUIRE(cstream.Transform(sample_books.data(), sample_books.size(), sink));
+        REQUIRE(cstream.End(sink));
+
+        ZstdCodec codec;
+        ZstdFrameInfo info;
+        REQUIRE(codec.FrameInfo(info, compressed_bytes).ok());
+        REQUIRE(info.has_checksum);
+        REQUIRE(info.window_size == (1u << 17));
+    }
+}
+
+
+TEST_CASE("Long-range mode", "[zstd][compress][decompress][params][stream]")
+{
+    // NOTE: incompressible block repeated beyond the default window of low levels
+    const usize block_size = 4 * 1024 * 1024;
+    Vec<u8> content_bytes(block_size);
+    std::uint32_t seed = 2463534242u;
+    for (auto& byte : content_bytes) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        byte = static_cast<u8>(seed);
+    }
+    content_bytes.resize(2 * block_size);
+    std::copy_n(std::begin(content_bytes), block_size, std::begin(content_bytes) + block_size);
+
+    ZstdCompressionParams params(3);
+    REQUIRE(params.SetLongRange(28));
+
+    ZstdCodec codec;
+
+    SECTION("codec") {
+        ByteBuffer default_bytes;
+        REQUIRE(codec.Compress(default_bytes, content_bytes.data(), content_bytes.size(), 3).ok());
+
+        ByteBuffer long_range_bytes;
+        REQUIRE(codec.Compress(long_range_bytes, content_bytes.data(), content_bytes.size(), params).ok());
+        REQUIRE(long_range_bytes.size() < default_bytes.size() * 3 / 5);
+
+        ByteBuffer result_bytes;
+        REQUIRE(codec.Decompress(result_bytes, long_range_bytes.data(), long_range_bytes.size()).ok());
+        REQUIRE(result_bytes.ToVec() == content_bytes);
+    }
+
+    SECTION("stream") {
+        Vec<u8> compressed_bytes;
+        const auto compress_sink = AppendSink(compressed_bytes);
+
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.Begin(params));
+        REQUIRE(cstream.Transform(content_bytes.data(), content_bytes.size(), compress_sink));
+        REQUIRE(cstream.End(compress_sink));
+        REQUIRE(compressed_bytes.size() < content_bytes.size() * 3 / 5);
+
+        ZstdFrameInfo info;
+        REQUIRE(codec.FrameInfo(info, compressed_bytes).ok());
+        REQUIRE(info.window_size == (1u << 28));
+
+        Vec<u8> result_bytes;
+        const auto decompress_sink = AppendSink(result_bytes);
+
+        // window exceeds the default limit
+        ZstdDecompressStream default_dstream;
+        REQUIRE(default_dstream.Begin());
+        REQUIRE_FALSE(default_dstream.Transform(compressed_bytes.data(), compressed_bytes.size(), decompress_sink));
+
+        ZstdDecompressStream dstream;
+        REQUIRE_FALSE(dstream.SetWindowLogMax(ZSTD_dParam_getBounds(ZSTD_d_windowLogMax).upperBound + 1));
+        REQUIRE(dstream.SetWindowLogMax(28));
+        REQUIRE(dstream.Begin());
+        REQUIRE(dstream.Transform(compressed_bytes.data(), compressed_bytes.size(), decompress_sink));
+        REQUIRE(dstream.End(decompress_sink));
+        REQUIRE(result_bytes == content_bytes);
+    }
+}
+
+
+TEST_CASE("Adaptive ZstdCompressStream", "[zstd][compress][decompress][stream][adaptive]")
+{
+    ByteBuffer content_bytes(6 * ZstdCompressStream::kAdaptivePeriod);
+    fillLargePayload(content_bytes.data(), content_bytes.size(), 0);
+
+    Vec<u8> compressed_bytes;
+    const auto compress = [&](ZstdCompressStream& cstream, const std::function<void()>& drain) {
+        const auto append = AppendSink(compressed_bytes);
+        const auto sink = [&](const u8* bytes, usize size) {
+            append(bytes, size);
+            drain();
+        };
+
+        // NOTE: small chunks, as producers do
+        for (usize offset = 0; offset < content_bytes.size(); offset += 64 * 1024) {
+            REQUIRE(cstream.Transform(content_bytes.data() + offset, 64 * 1024, sink));
+        }
+        REQUIRE(cstream.End(sink));
+    };
+
+    const auto verify = [&]() {
+        Vec<u8> result_bytes;
+        ZstdDecompressStream dstream;
+        REQUIRE(dstream.Begin());
+        REQUIRE(dstream.Transform(compressed_bytes, [&result_bytes](const ByteBuffer& decompressed) {
+            result_bytes.insert(std::end(result_bytes), std::begin(decompressed), std::end(decompressed));
+        }));
+        REQUIRE(result_bytes == content_bytes.ToVec());
+    };
+
+    SECTION("fast sink lowers level") {
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.BeginAdaptive(5, 1, 5));
+        compress(cstream, []() {});
+
+        const auto stats = cstream.AdaptiveStats();
+        REQUIRE(stats.level < 5);
+        REQUIRE(stats.level >= 1);
+        REQUIRE(stats.level_changes > 0);
+        REQUIRE(stats.consumed == content_bytes.size());
+        REQUIRE(stats.produced == compressed_bytes.size());
+
+        verify();
+    }
+
+    SECTION("slow sink raises level") {
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.BeginAdaptive(1, 1, 3));
+        compress(cstream, []() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); });
+
+        const auto stats = cstream.AdaptiveStats();
+        REQUIRE(stats.level > 1);
+        REQUIRE(stats.level <= 3);
+        REQUIRE(stats.sink_ns > stats.compress_ns);
+
+        verify();
+    }
+
+    REQUIRE_FALSE(ZstdCompressStream().BeginAdaptive(3, 5, 1));
+}
+
+
+TEST_CASE("ZstdCompressStream auto flush", "[zstd][compress][decompress][stream][latency]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const usize message_size = 100;
+
+    // NOTE: decode output as soon as it is emitted, to see what a receiver can read
+    usize decoded_size = 0;
+    ZstdDecompressStream dstream;
+    REQUIRE(dstream.Begin());
+    const auto sink = [&](const u8* bytes, usize size) {
+        REQUIRE(dstream.Transform(bytes, size, [&decoded_size](const u8*, usize size) {
+            decoded_size += size;
+        }));
+    };
+
+    ZstdCompressionParams params(3);
+    REQUIRE(params.SetTargetCBlockSize(2048));
+
+    SECTION("pending bytes limit") {
+        ZstdCompressStream cstream;
+        cstream.SetAutoFlush(1000, 0);
+        REQUIRE(cstream.Begin(params));
+
+        usize consumed = 0;
+        for (usize offset = 0; offset + message_size <= sample_books.size(); offset += message_size) {
+            REQUIRE(cstream.Transform(sample_books.data() + offset, message_size, sink));
+            consumed += message_size;
+            REQUIRE(consumed - decoded_size < 1000);
+        }
+        REQUIRE(cstream.End(sink));
+    }
+
+    SECTION("pending time limit") {
+        ZstdCompressStream cstream;
+        cstream.SetAutoFlush(0, 1000);
+        REQUIRE(cstream.Begin(params));
+
+        REQUIRE(cstream.Transform(sample_books.data(), message_size, sink));
+        REQUIRE(decoded_size == 0);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        REQUIRE(cstream.Poll(sink));
+        REQUIRE(decoded_size == message_size);
+        REQUIRE(cstream.End(sink));
+    }
+
+    SECTION("explicit flush") {
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.Begin(3));
+
+        REQUIRE(cstream.Transform(sample_books.data(), message_size, sink));
+        REQUIRE(cstream.Flush(sink));
+        REQUIRE(decoded_size == message_size);
+        REQUIRE(cstream.End(sink));
+    }
+}
+
+
+TEST_CASE("Delta compression using prefix", "[zstd][compress][decompress][prefix]")
+{
+    const auto reference = loadFixture("sample-books.json");
+
+    // next version, a few edits on the reference
+    auto content_bytes = reference;
+    content_bytes[100] ^= 0x20;
+    content_bytes.insert(std::begin(content_bytes) + content_bytes.size() / 2, { '{', '}', ',' });
+    content_bytes.erase(std::end(content_bytes) - 200, std::end(content_bytes) - 150);
+
+    ZstdCodec codec;
+    ByteBuffer full_bytes;
+    REQUIRE(codec.Compress(full_bytes, content_bytes.data(), content_bytes.size(), 3).ok());
+
+    SECTION("codec") {
+        ByteBuffer delta_bytes;
+        const auto rc = codec.CompressUsingPrefix(delta_bytes, content_bytes.data(), content_bytes.size(),
+                                                  reference.data(), reference.size(), 3);
+        REQUIRE(rc.ok());
+        REQUIRE(delta_bytes.size() * 20 < full_bytes.size());
+
+        ByteBuffer result_bytes;
+        REQUIRE(codec.DecompressUsingPrefix(result_bytes, delta_bytes.data(), delta_bytes.size(),
+                                            reference.data(), reference.size()).ok());
+        REQUIRE(result_bytes.ToVec() == content_bytes);
+
+        // cannot restore without the reference
+        const auto plain_rc = codec.Decompress(result_bytes, delta_bytes.data(), delta_bytes.size());
+        REQUIRE((!plain_rc.ok() || result_bytes.ToVec() != content_bytes));
+    }
+
+    SECTION("stream") {
+        Vec<u8> delta_bytes;
+        ZstdCompressStream cstream;
+        REQUIRE(cstream.BeginUsingPrefix(reference.data(), reference.size(), 3));
+        const auto compress_sink = AppendSink(delta_bytes);
+        REQUIRE(cstream.Transform(content_bytes.data(), content_bytes.size(), compress_sink));
+        REQUIRE(cstream.End(compress_sink));
+        REQUIRE(delta_bytes.size() * 20 < full_bytes.size());
+
+        Vec<u8> result_bytes;
+        ZstdDecompressStream dstream;
+        REQUIRE(dstream.BeginUsingPrefix(reference.data(), reference.size()));
+        REQUIRE(dstream.Transform(delta_bytes.data(), delta_bytes.size(), AppendSink(result_bytes)));
+        REQUIRE(result_bytes == content_bytes);
+    }
+
+    SECTION("patch-from window") {
+        ZstdCompressionParams params(3);
+        REQUIRE(params.SetPatchFrom(64 * 1024 * 1024, 64 * 1024 * 1024));
+
+        int window_log = 0;
+        REQUIRE(params.Get(ZSTD_c_windowLog, window_log));
+        REQUIRE(window_log == 27);
+        REQUIRE(params.LongDistanceMatching());
+    }
+}
+
+
+TEST_CASE("ZstdDictTrainer", "[zstd][compress][decompress][dictionary][trainer]")
+{
+    // one sample per line (a book), first 80 books to train and the rest to evaluate
+    const auto sample_books = loadFixture("sample-books.json");
+    Vec<Vec<u8>> books;
+    for (auto begin = std::begin(sample_books); begin != std::end(sample_books); ) {
+        const auto end = std::find(begin, std::end(sample_books), '\n');
+        books.emplace_back(begin, end);
+        begin = end == std::end(sample_books) ? end : end + 1;
+    }
+    REQUIRE(books.size() == 100);
+
+    ZstdDictTrainer trainer(4 * 1024);
+    for (usize i = 0; i < 80; ++i) trainer.AddSample(books[i]);
+    REQUIRE(trainer.SampleCount() == 80);
+
+    const auto compression_level = 3;
+    const auto evaluate = [&](const Vec<u8>& dict_bytes) {
+        ZstdCompressionDict cdict(dict_bytes, compression_level);
+        ZstdDecompressionDict ddict(dict_bytes);
+        REQUIRE_FALSE(cdict.fail());
+        REQUIRE_FALSE(ddict.fail());
+
+        ZstdCodec codec;
+        usize plain_size = 0;
+        usize dict_size = 0;
+        for (usize i = 80; i < books.size(); ++i) {
+            ByteBuffer compressed_bytes;
+            REQUIRE(codec.Compress(compressed_bytes, books[i].data(), books[i].size(), compression_level).ok());
+            plain_size += compressed_bytes.size();
+
+            REQUIRE(codec.CompressUsingDict(compressed_bytes, books[i].data(), books[i].size(), cdict).ok());
+            dict_size += compressed_bytes.size();
+
+            ByteBuffer content_bytes;
+            REQUIRE(codec.DecompressUsingDict(content_bytes, compressed_bytes.data(), compressed_bytes.size(), ddict).ok());
+            REQUIRE(content_bytes.ToVec() == books[i]);
+        }
+
+        // NOTE: small records share most of their structure, a dictionary should help a lot
+        REQUIRE(dict_size * 2 < plain_size);
+    };
+
+    SECTION("train") {
+        Vec<u8> dict_bytes;
+        const auto rc = trainer.Train(dict_bytes);
+        REQUIRE(rc.ok());
+        REQUIRE(dict_bytes.size() == rc.size);
+        REQUIRE(dict_bytes.size() <= trainer.DictCapacity());
+        REQUIRE(ZDICT_getDictID(dict_bytes.data(), dict_bytes.size()) != 0);
+
+        evaluate(dict_bytes);
+    }
+
+    SECTION("train optimized, multi-threaded") {
+        Vec<u8> dict_bytes;
+        REQUIRE(trainer.TrainOptimized(dict_bytes, compression_level, 2).ok());
+
+        evaluate(dict_bytes);
+    }
+
+    SECTION("too few samples") {
+        trainer.Clear();
+        trainer.AddSample(books[0]);
+
+        Vec<u8> dict_bytes;
+        REQUIRE(trainer.Train(dict_bytes).error == ZstdError::Zstd);
+        REQUIRE(dict_bytes.empty());
+    }
+}
+
+
+// NOTE: copy of a zstd dictionary with another dictID (little-endian, bytes 4-7)
+static Vec<u8> withDictId(const Vec<u8>& dict_bytes, u32 dict_id)
+{
+    auto bytes = dict_bytes;
+    for (auto i = 0; i < 4; ++i) bytes[4 + i] = static_cast<u8>(dict_id >> (8 * i));
+    return bytes;
+}
+
+
+// NOTE: 4KiB dictionary trained on sample-books.json, one sample per line
+static Vec<u8> trainBooksDict(const Vec<u8>& sample_books)
+{
+    ZstdDictTrainer trainer(4 * 1024);
+    for (auto begin = std::begin(sample_books); begin != std::end(sample_books); ) {
+        const auto end = std::find(begin, std::end(sample_books), '\n');
+        trainer.AddSample(&*begin, static_cast<usize>(end - begin));
+        begin = end == std::end(sample_books) ? end : end + 1;
+    }
+
+    Vec<u8> dict_bytes;
+    trainer.Train(dict_bytes);
+    return dict_bytes;
+}
+
+
+TEST_CASE("ZstdDictRegistry", "[zstd][compress][decompress][dictionary][registry]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto trained_bytes = trainBooksDict(sample_books);
+    REQUIRE_FALSE(trained_bytes.empty());
+
+    const auto roundtrip = [&](const ZstdCompressionDict& cdict, const ZstdDecompressionDict& ddict) {
+        ZstdCodec codec;
+        ByteBuffer compressed_bytes;
+        ByteBuffer content_bytes;
+        return codec.CompressUsingDict(compressed_bytes, sample_books.data(), sample_books.size(), cdict).ok() &&
+               codec.DecompressUsingDict(content_bytes, compressed_bytes.data(), compressed_bytes.size(), ddict).ok() &&
+               content_bytes.ToVec() == sample_books;
+    };
+
+    SECTION("register and share digested dictionaries") {
+        ZstdDictRegistry registry(64 * 1024 * 1024);
+        const auto dict_id = registry.Register(trained_bytes);
+        REQUIRE(dict_id == ZDICT_getDictID(trained_bytes.data(), trained_bytes.size()));
+        REQUIRE(registry.Contains(dict_id));
+        REQUIRE(registry.Register(trained_bytes) == 0);     // already registered
+        REQUIRE(registry.Register(Vec<u8>(1024, 'a')) == 0);   // raw content has no dictID
+
+        const auto cdict = registry.CompressionDict(dict_id, 3);
+        const auto ddict = registry.DecompressionDict(dict_id);
+        REQUIRE(cdict);
+        REQUIRE(ddict);
+        REQUIRE(roundtrip(*cdict, *ddict));
+
+        REQUIRE(registry.CompressionDict(dict_id, 3) == cdict);
+        REQUIRE(registry.DecompressionDict(dict_id) == ddict);
+        REQUIRE(registry.CompressionDict(dict_id, 5) != cdict);
+        REQUIRE(registry.CompressionDict(dict_id + 1, 3) == nullptr);
+
+        auto stats = registry.Stats();
+        REQUIRE(stats.dicts == 1);
+        REQUIRE(stats.digested == 3);
+        REQUIRE(stats.created == 3);
+        REQUIRE(stats.memory_usage > 0);
+
+        // handles outlive unregistration
+        REQUIRE(registry.Unregister(dict_id));
+        REQUIRE_FALSE(registry.Contains(dict_id));
+        REQUIRE(registry.CompressionDict(dict_id, 3) == nullptr);
+        REQUIRE(registry.Stats().memory_usage == 0);
+        REQUIRE(roundtrip(*cdict, *ddict));
+    }
+
+    SECTION("evict least recently used under memory budget") {
+        ZstdDictRegistry probe(64 * 1024 * 1024);
+        const auto probe_id = probe.Register(trained_bytes);
+        REQUIRE(probe.CompressionDict(probe_id, 3));
+        const auto cdict_memory = probe.Stats().memory_usage;
+
+        // room for two digested dictionaries
+        ZstdDictRegistry registry(cdict_memory * 5 / 2);
+        Vec<u32> dict_ids;
+        for (u32 i = 0; i < 4; ++i) {
+            dict_ids.push_back(registry.Register(withDictId(trained_bytes, 1000 + i)));
+            REQUIRE(dict_ids.back() == 1000 + i);
+        }
+
+        const auto first = registry.CompressionDict(dict_ids[0], 3);
+        REQUIRE(registry.CompressionDict(dict_ids[1], 3));
+        REQUIRE(registry.CompressionDict(dict_ids[0], 3) == first);     // [1] is now least recently used
+        REQUIRE(registry.CompressionDict(dict_ids[2], 3));
+
+        auto stats = registry.Stats();
+        REQUIRE(stats.digested == 2);
+        REQUIRE(stats.evictions == 1);
+        REQUIRE(stats.memory_usage <= cdict_memory * 5 / 2);
+        REQUIRE(registry.CompressionDict(dict_ids[0], 3) == first);
+
+        // evicted dictionaries are digested again, outstanding handles stay usable
+        REQUIRE(registry.CompressionDict(dict_ids[3], 3));
+        REQUIRE(registry.CompressionDict(dict_ids[0], 3) != nullptr);
+        REQUIRE(registry.Stats().evictions >= 2);
+
+        const auto ddict = registry.DecompressionDict(dict_ids[0]);
+        REQUIRE(ddict);
+        REQUIRE(roundtrip(*first, *ddict));
+    }
+
+    SECTION("concurrent lookups") {
+        ZstdDictRegistry registry(64 * 1024 * 1024);
+        Vec<u32> dict_ids;
+        for (u32 i = 0; i < 8; ++i) {
+            dict_ids.push_back(registry.Register(withDictId(trained_bytes, 2000 + i)));
+        }
+
+        const auto thread_count = 8;
+        std::atomic<int> failures(0);
+        Vec<std::thread> threads;
+        for (auto t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t]() {
+                for (auto i = 0; i < 200; ++i) {
+                    const auto dict_id = dict_ids[(t + i) % dict_ids.size()];
+                    const auto cdict = registry.CompressionDict(dict_id, 1 + i % 3);
+                    const auto ddict = registry.DecompressionDict(dict_id);
+                    if (!cdict || !ddict) { ++failures; continue; }
+                    if (i % 50 == 0 && !roundtrip(*cdict, *ddict)) ++failures;
+                }
+            });
+        }
+
+        for (auto& thread : threads) thread.join();
+        REQUIRE(failures == 0);
+
+        // every dictionary is digested once per level, shared by all threads
+        const auto stats = registry.Stats();
+        REQUIRE(stats.created == stats.digested);
+        REQUIRE(stats.digested == dict_ids.size() * 4);
+    }
+}
+
+
+TEST_CASE("Dictionaries loaded by reference", "[zstd][compress][decompress][dictionary][mmap]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto dict_bytes = trainBooksDict(sample_books);
+    REQUIRE_FALSE(dict_bytes.empty());
+
+    const auto dict_path = tempPath("sample-books.dict");
+    {
+        FileResource dict_file(dict_path, "wb");
+        REQUIRE(fwrite(dict_bytes.data(), 1, dict_bytes.size(), dict_file.get()) == dict_bytes.size());
+    }
+
+    const auto roundtrip = [&](const ZstdCompressionDict& cdict, const ZstdDecompressionDict& ddict) {
+        ZstdCodec codec;
+        ByteBuffer compressed_bytes;
+        ByteBuffer content_bytes;
+        return codec.CompressUsingDict(compressed_bytes, sample_books.data(), sample_books.size(), cdict).ok() &&
+               codec.DecompressUsingDict(content_bytes, compressed_bytes.data(), compressed_bytes.size(), ddict).ok() &&
+               content_bytes.ToVec() == sample_books;
+    };
+
+    SECTION("memory-mapped file") {
+        auto file = std::make_shared<const MappedFile>(dict_path);
+        REQUIRE_FALSE(file->fail());
+        REQUIRE(file->size() == dict_bytes.size());
+        REQUIRE(std::equal(file->data(), file->data() + file->size(), dict_bytes.data()));
+
+        ZstdCompressionDict cdict(file, 3);
+        ZstdDecompressionDict ddict(file);
+        REQUIRE_FALSE(cdict.fail());
+        REQUIRE_FALSE(ddict.fail());
+
+        // NOTE: dictionaries keep the mapping alive
+        std::weak_ptr<const MappedFile> mapping = file;
+        file.reset();
+        REQUIRE_FALSE(mapping.expired());
+        REQUIRE(roundtrip(cdict, ddict));
+
+        // by reference, the dictionary content is not copied
+        ZstdCompressionDict copied_cdict(dict_bytes, 3);
+        REQUIRE(ZSTD_sizeof_CDict(cdict.get()) + dict_bytes.size() <= ZSTD_sizeof_CDict(copied_cdict.get()));
+    }
+
+    SECTION("external span with owner") {
+        auto owner = std::make_shared<const Vec<u8>>(dict_bytes);
+        ZstdCompressionDict cdict(owner->data(), owner->size(), 3, owner);
+        ZstdDecompressionDict ddict(owner->data(), owner->size(), owner);
+        std::weak_ptr<const Vec<u8>> bytes = owner;
+        owner.reset();
+        REQUIRE_FALSE(bytes.expired());
+        REQUIRE(roundtrip(cdict, ddict));
+    }
+
+    SECTION("registry keeps the mapping") {
+        ZstdDictRegistry registry(64 * 1024 * 1024);
+        auto file = std::make_shared<const MappedFile>(dict_path);
+        std::weak_ptr<const MappedFile> mapping = file;
+        const auto dict_id = registry.Register(std::move(file));
+        REQUIRE(dict_id != 0);
+
+        const auto cdict = registry.CompressionDict(dict_id, 3);
+        const auto ddict = registry.DecompressionDict(dict_id);
+        REQUIRE(registry.Unregister(dict_id));
+        REQUIRE_FALSE(mapping.expired());
+        REQUIRE(roundtrip(*cdict, *ddict));
+    }
+
+    SECTION("missing file") {
+        const auto file = std::make_shared<const MappedFile>(tempPath("no-such-file.dict"));
+        REQUIRE(file->fail());
+        REQUIRE(file->size() == 0);
+        REQUIRE(ZstdCompressionDict(file, 3).fail());
+        REQUIRE(ZstdDecompressionDict(file).fail());
+
+        ZstdDictRegistry registry(64 * 1024 * 1024);
+        REQUIRE(registry.Register(file) == 0);
+    }
+}
+
+
+TEST_CASE("Dictionary selection by frame dictID", "[zstd][decompress][dictionary][dictset]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto trained_bytes = trainBooksDict(sample_books);
+    REQUIRE_FALSE(trained_bytes.empty());
+
+    // NOTE: frames of 3 producers using different dictionaries, and a frame without dictionary
+    ZstdCodec codec;
+    ZstdDecompressionDictSet ddicts;
+    ByteBuffer frames;
+    Vec<u8> contents;
+    for (u32 i = 0; i < 4; ++i) {
+        const Vec<u8> content(sample_books.begin() + i * 1000, sample_books.begin() + (i + 1) * 1000);
+        ByteBuffer frame;
+        if (i < 3) {
+            const auto dict_bytes = withDictId(trained_bytes, 3000 + i);
+            REQUIRE(ddicts.Add(std::make_shared<const ZstdDecompressionDict>(dict_bytes)) == 3000 + i);
+            REQUIRE(codec.CompressUsingDict(frame, content.data(), content.size(), ZstdCompressionDict(dict_bytes, 3)).ok());
+        }
+        else {
+            REQUIRE(codec.Compress(frame, content.data(), content.size(), 3).ok());
+        }
+
+        frames.append(frame.data(), frame.size());
+        contents.insert(contents.end(), content.begin(), content.end());
+    }
+
+    REQUIRE(ddicts.Size() == 3);
+    REQUIRE(ddicts.Find(3001) != nullptr);
+    REQUIRE(ddicts.Find(4000) == nullptr);
+    REQUIRE(ddicts.Add(std::make_shared<const ZstdDecompressionDict>(withDictId(trained_bytes, 3001))) == 0);
+
+    SECTION("codec") {
+        ByteBuffer content_bytes;
+        REQUIRE(codec.DecompressUsingDicts(content_bytes, frames.data(), frames.size(), ddicts).ok());
+        REQUIRE(content_bytes.ToVec() == contents);
+
+        REQUIRE(ddicts.Remove(3001));
+        const auto result = codec.DecompressUsingDicts(content_bytes, frames.data(), frames.size(), ddicts);
+        REQUIRE(result.error == ZstdError::Zstd);
+        REQUIRE(result.zstd_code == ZSTD_error_dictionary_wrong);
+    }
+
+    SECTION("stream") {
+        Vec<u8> content_bytes;
+        const auto sink = [&content_bytes](const u8* data, usize size) {
+            content_bytes.insert(content_bytes.end(), data, data + size);
+        };
+
+        ZstdDecompressStream dstream;
+        REQUIRE(dstream.Begin(ddicts));
+        for (usize offset = 0; offset < frames.size(); offset += 100) {
+            const auto size = std::min<usize>(100, frames.size() - offset);
+            REQUIRE(dstream.Transform(frames.data() + offset, size, sink));
+        }
+        REQUIRE(dstream.End(sink));
+        REQUIRE(content_bytes == contents);
+    }
+}
+
+
+// NOTE: small json records of a schema unlike sample-books.json
+static Vec<u8> makeEventRecord(u32 index)
+{
+    static const char* const kEvents[] = { "page_view", "add_to_cart", "checkout", "search" };
+    char record[256];
+    const auto size = snprintf(record, sizeof(record),
+                               "{\"event_id\":%u,\"event\":\"%s\",\"user\":{\"id\":%u,\"region\":\"ap-northeast-%u\"},"
+                               "\"timestamp\":\"2026-10-%02uT%02u:%02u:00Z\",\"value\":%u}",
+                               index, kEvents[index % 4], (index * 7919u) % 100000u, 1u + index % 3,
+                               1u + index % 28, index % 24, index % 60, (index * 31u) % 1000u);
+    return Vec<u8>(record, record + size);
+}
+
+
+TEST_CASE("ZstdDictRetrainer", "[zstd][compress][dictionary][retrain]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto books_dict = trainBooksDict(sample_books);
+    REQUIRE_FALSE(books_dict.empty());
+
+    ZstdDictRegistry registry(64 * 1024 * 1024);
+    const auto books_dict_id = registry.Register(books_dict);
+    REQUIRE(books_dict_id != 0);
+
+    ZstdDictRetrainOptions options;
+    options.sample_rate = 0.5;
+    options.min_ratio = 2.0;
+    options.window_samples = 200;
+    options.dict_capacity = 4 * 1024;
+
+    ZstdDictRetrainer retrainer(registry, books_dict_id, options);
+    ZstdCodec codec;
+    codec.SetDictObserver(&retrainer);
+
+    // payloads drifted away from the dictionary
+    Vec<ByteBuffer> old_frames;
+    for (u32 i = 0; i < 400; ++i) {
+        const auto record = makeEventRecord(i);
+        ByteBuffer compressed_bytes;
+        REQUIRE(codec.CompressUsingDict(compressed_bytes, record.data(), record.size(), *retrainer.CompressionDict()).ok());
+        if (i < 10) old_frames.push_back(std::move(compressed_bytes));
+    }
+
+    retrainer.Wait();
+    const auto stats = retrainer.Stats();
+    REQUIRE(stats.sampled == 200);
+    REQUIRE(stats.retrains == 1);
+    REQUIRE(stats.published == 1);
+    REQUIRE(retrainer.Ratio(books_dict_id) < options.min_ratio);
+
+    const auto new_dict_id = retrainer.DictId();
+    REQUIRE(new_dict_id != books_dict_id);
+    REQUIRE(registry.Contains(new_dict_id));
+
+    // new compressions use the retrained dictionary
+    for (u32 i = 400; i < 800; ++i) {
+        const auto record = makeEventRecord(i);
+        ByteBuffer compressed_bytes;
+        REQUIRE(codec.CompressUsingDict(compressed_bytes, record.data(), record.size(), *retrainer.CompressionDict()).ok());
+        REQUIRE(ZSTD_getDictID_fromFrame(compressed_bytes.data(), compressed_bytes.size()) == new_dict_id);
+    }
+
+    retrainer.Wait();
+    REQUIRE(retrainer.Ratio(new_dict_id) >= options.min_ratio);
+    REQUIRE(retrainer.Stats().retrains == 1);
+
+    // frames of the previous dictionary can still be decompressed
+    const auto old_ddict = registry.DecompressionDict(books_dict_id);
+    REQUIRE(old_ddict);
+    for (u32 i = 0; i < old_frames.size(); ++i) {
+        ByteBuffer content_bytes;
+        REQUIRE(codec.DecompressUsingDict(content_bytes, old_frames[i].data(), old_frames[i].size(), *old_ddict).ok());
+        REQUIRE(content_bytes.ToVec() == makeEventRecord(i));
+    }
+
+    codec.SetDictObserver(nullptr);
+}
+
+
+TEST_CASE("Objects placed in caller's workspace", "[zstd][compress][decompress][dictionary][workspace]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto dict_bytes = trainBooksDict(sample_books);
+    REQUIRE_FALSE(dict_bytes.empty());
+
+    const auto compression_level = 3;
+    const auto cctx_size = CompressContext::EstimateSize(compression_level, sample_books.size());
+    const auto dctx_size = DecompressContext::EstimateSize();
+    const auto cdict_size = ZstdCompressionDict::EstimateSize(dict_bytes.size(), compression_level);
+    const auto ddict_size = ZstdDecompressionDict::EstimateSize(dict_bytes.size());
+    REQUIRE(cctx_size < CompressContext::EstimateSize(compression_level));
+
+    // NOTE: a single arena sized up front, u64 elements keep workspaces 8-byte aligned
+    const auto align = [](usize size) { return (size + 7) / 8 * 8; };
+    Vec<u64> arena((align(cctx_size) + align(dctx_size) + align(cdict_size) + align(ddict_size)) / 8);
+    auto arena_bytes = reinterpret_cast<u8*>(arena.data());
+    const auto place = [&](usize size) {
+        const ZstdWorkspace workspace { arena_bytes, size };
+        arena_bytes += align(size);
+        return workspace;
+    };
+
+    CompressContext cctx(place(cctx_size));
+    DecompressContext dctx(place(dctx_size));
+    ZstdCompressionDict cdict(dict_bytes.data(), dict_bytes.size(), compression_level, place(cdict_size));
+    ZstdDecompressionDict ddict(dict_bytes.data(), dict_bytes.size(), place(ddict_size));
+    REQUIRE_FALSE(cctx.fail());
+    REQUIRE_FALSE(dctx.fail());
+    REQUIRE_FALSE(cdict.fail());
+    REQUIRE_FALSE(ddict.fail());
+
+    const ZstdCodec codec(cctx, dctx);
+    Vec<u8> compressed_bytes(codec.CompressBound(sample_books.size()).size);
+    Vec<u8> content_bytes(sample_books.size());
+
+    SECTION("simple api") {
+        const auto rc = codec.Compress(compressed_bytes, sample_books, compression_level);
+        REQUIRE(rc.ok());
+        compressed_bytes.resize(rc.size);
+
+        REQUIRE(codec.Decompress(content_bytes, compressed_bytes).size == sample_books.size());
+        REQUIRE(content_bytes == sample_books);
+
+        // a context sized for small inputs can not compress larger ones
+        const auto large_level = 19;
+        const auto result = codec.Compress(compressed_bytes.data(), compressed_bytes.capacity(),
+                                           sample_books.data(), sample_books.size(), large_level);
+        REQUIRE(result.error == ZstdError::Zstd);
+        REQUIRE(result.zstd_code == ZSTD_error_memory_allocation);
+    }
+
+    SECTION("dictionary api") {
+        const auto rc = codec.CompressUsingDict(compressed_bytes, sample_books, cdict);
+        REQUIRE(rc.ok());
+        compressed_bytes.resize(rc.size);
+
+        REQUIRE(codec.DecompressUsingDict(content_bytes, compressed_bytes, ddict).size == sample_books.size());
+        REQUIRE(content_bytes == sample_books);
+    }
+
+    SECTION("workspace too small") {
+        Vec<u64> small(64);
+        const ZstdWorkspace workspace { small.data(), small.size() * sizeof(u64) };
+        REQUIRE(CompressContext(workspace).fail());
+        REQUIRE(DecompressContext(workspace).fail());
+        REQUIRE(ZstdCompressionDict(dict_bytes.data(), dict_bytes.size(), compression_level, workspace).fail());
+        REQUIRE(ZstdDecompressionDict(dict_bytes.data(), dict_bytes.size(), workspace).fail());
+    }
+}
+
+
+// NOTE: counts calls, and bytes in use, of zstd's allocations
+class CountingAllocator : public IZstdAllocator
+{
+public:
+    CountingAllocator() : allocations(0), frees(0), in_use(0), sizes() {}
+
+    virtual void* Allocate(usize size)
+    {
+        auto address = std::malloc(size);
+        allocations += 1;
+        in_use += size;
+        sizes[address] = size;
+        return address;
+    }
+
+    virtual void Free(void* address)
+    {
+        if (address == nullptr) return;
+        frees += 1;
+        in_use -= sizes[address];
+        sizes.erase(address);
+        std::free(address);
+    }
+
+    usize allocations;
+    usize frees;
+    usize in_use;
+    std::map<void*, usize> sizes;
+};
+
+
+TEST_CASE("Custom allocators", "[zstd][compress][decompress][allocator]")
+{
+    const auto sample_books = loadFixture("sample-books.json");
+    const auto compression_level = 3;
+
+    const auto roundtrip = [&](const ZstdCodec& codec) {
+        ByteBuffer compressed_bytes;
+        ByteBuffer content_bytes;
+        return codec.Compress(compressed_bytes, sample_books.data(), sample_books.size(), compression_level).ok() &&
+               codec.Decompress(content_bytes, compressed_bytes.data(), compressed_bytes.size()).ok() &&
+               content_bytes.ToVec() == sample_books;
+    };
+
+    SECTION("every zstd allocation goes through the allocator") {
+        CountingAllocator allocator;
+        {
+            const ZstdCodec codec(allocator);
+            REQUIRE(roundtrip(codec));
+            REQUIRE(allocator.allocations > 0);
+            REQUIRE(allocator.in_use > 0);
+
+            const auto dict_bytes = trainBooksDict(sample_books);
+            const auto allocations = allocator.allocations;
+            ZstdCompressionDict cdict(dict_bytes, compression_level, allocator);
+            ZstdDecompressionDict ddict(dict_bytes, allocator);
+            REQUIRE_FALSE(cdict.fail());
+            REQUIRE_FALSE(ddict.fail());
+            REQUIRE(allocator.allocations > allocations);
+
+            ByteBuffer compressed_bytes;
+            ByteBuffer content_bytes;
+            REQUIRE(codec.CompressUsingDict(compressed_bytes, sample_books.data(), sample_books.size(), cdict).ok());
+            REQUIRE(codec.DecompressUsingDict(content_bytes, compressed_bytes.data(), compressed_bytes.size(), ddict).ok());
+            REQUIRE(content_bytes.ToVec() == sample_books);
+
+            // NOTE: contexts are reused, compressing again does not allocate
+            const auto warm_allocations = allocator.allocations;
+            REQUIRE(codec.CompressUsingDict(compressed_bytes, sample_books.data(), sample_books.size(), cdict).ok());
+            REQUIRE(allocator.allocations == warm_allocations);
+        }
+
+        {
+            const auto allocations = allocator.allocations;
+            Vec<u8> compressed_bytes;
+            ZstdCompressStream cstream(allocator);
+            REQUIRE(cstream.Begin(compression_level));
+            REQUIRE(cstream.Transform(sample_books, [&](const ByteBuffer& bytes) {
+                compressed_bytes.insert(compressed_bytes.end(), bytes.begin(), bytes.end());
+            }));
+            REQUIRE(cstream.End([&](const ByteBuffer& bytes) {
+                compressed_bytes.insert(compressed_bytes.end(), bytes.begin(), bytes.end());
+            }));
+            REQUIRE(allocator.allocations > allocations);
+
+            const auto stream_allocations = allocator.allocations;
+            Vec<u8> content_bytes;
+            ZstdDecompressStream dstream(allocator);
+            REQUIRE(dstream.Begin());
+            REQUIRE(dstream.Transform(compressed_bytes, [&](const ByteBuffer& bytes) {
+                content_bytes.insert(content_bytes.end(), bytes.begin(), bytes.end());
+            }));
+            REQUIRE(dstream.End([&](const ByteBuffer&) {}));
+            REQUIRE(allocator.allocations > stream_allocations);
+            REQUIRE(content_bytes == sample_books);
+        }
+
+        REQUIRE(allocator.frees == allocator.allocations);
+        REQUIRE(allocator.in_use == 0);
+    }
+
+    SECTION("pool allocator recycles workspaces") {
+        ZstdPoolAllocator allocator(64 * 1024 * 1024);
+        for (auto i = 0; i < 10; ++i) {
+            const ZstdCodec codec(allocator);
+            REQUIRE(roundtrip(codec));
+        }
+
+        const auto stats = allocator.Stats();
+        REQUIRE(stats.frees == stats.allocations);
+        REQUIRE(stats.system_allocations * 10 == stats.allocations);
+        REQUIRE(allocator.CachedBytes() > 0);
+
+        ZstdPoolAllocator no_cache(0);
+        for (auto i = 0; i < 2; ++i) {
+            REQUIRE(roundtrip(ZstdCodec(no_cache)));
+        }
+        REQUIRE(no_cache.Stats().system_allocations == no_cache.Stats().allocations);
+        REQUIRE(no_cache.CachedBytes() == 0);
+    }
+
+    SECTION("arena allocator") {
+        ZstdArenaAllocator allocator(16 * 1024 * 1024);
+        for (auto i = 0; i < 3; ++i) {
+            {
+                const ZstdCodec codec(allocator);
+                REQUIRE(roundtrip(codec));
+                REQUIRE(allocator.Used() > 0);
+            }
+            allocator.Reset();
+            REQUIRE(allocator.Used() == 0);
+        }
+
+        const auto stats = allocator.Stats();
+        REQUIRE(stats.frees == stats.allocations);
+        REQUIRE(stats.system_allocations == 1);
+        REQUIRE(allocator.HighWater() <= allocator.Capacity());
+
+        // NOTE: an exhausted arena fails compression, but never crashes
+        ZstdArenaAllocator small(16 * 1024);
+        const ZstdCodec codec(small);
+        ByteBuffer compressed_bytes;
+        const auto result = codec.Compress(compressed_bytes, sample_books.data(), sample_books.size(), compression_level);
+        REQUIRE_FALSE(result.ok());
+    }
+}
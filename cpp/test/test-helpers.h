@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "common-types.h"
+#include "raii-resource.h"
+
+
+class FileResource : public Resource<FILE>
+{
+public:
+    FileResource(const std::string& path, const char* mode)
+        : FileResource(path.c_str(), mode)
+    {
+    }
+
+    FileResource(const char* path, const char* mode)
+        : Resource(fopen(path, mode), fclose)
+    {
+    }
+};
+
+
+inline std::string fixturePath(const char* name)
+{
+    static const std::string kFixturePath("test/fixtures");
+    return kFixturePath + "/" + name;
+}
+
+
+inline std::string tempPath(const char* name)
+{
+    static const std::string kTempPath("test/tmp");
+    return kTempPath + "/" + name;
+}
+
+
+inline Vec<u8> loadFixture(const char* name)
+{
+    const auto path = fixturePath(name);
+    std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+    return Vec<u8>((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+}
+
+
+// stream sink appending the output to `dest`
+inline auto AppendSink(Vec<u8>& dest)
+{
+    return [&dest](const u8* bytes, usize size) {
+        dest.insert(std::end(dest), bytes, bytes + size);
+    };
+}
@@ -32,6 +32,14 @@ const onReady = (binding) => {
         return rc >= 0 ? rc : null;
     };
 
+    const decompressedSizeImpl = (src_vec) => {
+        // NOTE: bindings built before `decompressedSize` only see the first frame
+        if (typeof codec.decompressedSize !== 'function') return contentSizeImpl(src_vec);
+
+        const rc = codec.decompressedSize(src_vec);
+        return rc >= 0 ? rc : null;
+    };
+
     class ArrayBufferSink {
         constructor(initial_size) {
             this._buffer = new ArrayBuffer(initial_size);
@@ -102,7 +110,7 @@ const onReady = (binding) => {
                 return withCppVector((dest) => {
                     binding.cloneToVector(src, compressed_bytes);
 
-                    const contentSize = contentSizeImpl(src);
+                    const contentSize = decompressedSizeImpl(src);
                     if (!contentSize) return null;
 
                     dest.resize(contentSize, 0);
@@ -141,7 +149,7 @@ const onReady = (binding) => {
                 return withCppVector((dest) => {
                     binding.cloneToVector(src, compressed_bytes);
 
-                    const contentSize = contentSizeImpl(src);
+                    const contentSize = decompressedSizeImpl(src);
                     if (!contentSize) return null;
 
                     dest.resize(contentSize, 0);